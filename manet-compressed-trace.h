@@ -0,0 +1,213 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_COMPRESSED_TRACE_H
+#define MANET_COMPRESSED_TRACE_H
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+/**
+ * Streaming compression for trace files that ns-3 helpers open by name.
+ *
+ * Prepare () replaces the trace file name with a FIFO and starts a gzip
+ * or zstd process that reads the FIFO and writes the compressed stream
+ * to the file name plus ".gz" or ".zst".  The AsciiTraceHelper and
+ * PcapHelper then open and write the FIFO as if it were the trace file,
+ * and the compression runs on another core, so Simulator::Run only waits
+ * when the compressor falls more than a pipe buffer behind.  The output
+ * is a standard gzip or zstd stream (zcat, zstdcat, tcpdump -r - ...).
+ *
+ * Wait () must be called once every trace file has been closed, i.e.
+ * after the nodes that hold the trace sinks are gone; it blocks until
+ * then.  The destructor does not wait: it only removes the FIFOs left.
+ */
+class TraceCompressor
+{
+public:
+  enum Codec
+  {
+    NONE,
+    GZIP,
+    ZSTD
+  };
+
+  TraceCompressor ()
+    : m_codec (NONE)
+  {
+  }
+
+  ~TraceCompressor ()
+  {
+    for (std::vector<Stream>::iterator i = m_streams.begin (); i != m_streams.end (); ++i)
+      {
+        // as in Wait (), but a compressor whose writer is still open
+        // is left to finish when that writer exits
+        int fd = open (i->fifo.c_str (), O_WRONLY | O_NONBLOCK);
+        if (fd >= 0)
+          {
+            close (fd);
+          }
+        unlink (i->fifo.c_str ());
+        waitpid (i->pid, 0, WNOHANG);
+      }
+  }
+
+  /// \return false if name is not one of none, gzip or zstd
+  bool SetCodec (const std::string &name)
+  {
+    if (name == "none")
+      {
+        m_codec = NONE;
+      }
+    else if (name == "gzip")
+      {
+        m_codec = GZIP;
+      }
+    else if (name == "zstd")
+      {
+        m_codec = ZSTD;
+      }
+    else
+      {
+        return false;
+      }
+    return true;
+  }
+
+  bool IsEnabled (void) const
+  {
+    return m_codec != NONE;
+  }
+
+  /**
+   * Route fileName through the compressor.  Does nothing if no codec is
+   * selected.
+   *
+   * \return false if the FIFO or the compressor process cannot be created
+   */
+  bool Prepare (const std::string &fileName)
+  {
+    if (m_codec == NONE)
+      {
+        return true;
+      }
+    std::string output = fileName + (m_codec == GZIP ? ".gz" : ".zst");
+    unlink (fileName.c_str ());
+    if (mkfifo (fileName.c_str (), 0644) != 0)
+      {
+        return false;
+      }
+    int out = open (output.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+      {
+        unlink (fileName.c_str ());
+        return false;
+      }
+
+    const char *gzip[] = { "gzip", "-c", "-3", 0 };
+    const char *zstd[] = { "zstd", "-q", "-c", "-3", 0 };
+    const char **argv = m_codec == GZIP ? gzip : zstd;
+    pid_t pid = fork ();
+    if (pid == 0)
+      {
+        // blocks until the trace helper opens the FIFO for writing
+        int in = open (fileName.c_str (), O_RDONLY);
+        if (in < 0)
+          {
+            _exit (127);
+          }
+#ifdef F_SETPIPE_SZ
+        fcntl (in, F_SETPIPE_SZ, 1024 * 1024);
+#endif
+        dup2 (in, STDIN_FILENO);
+        dup2 (out, STDOUT_FILENO);
+        close (in);
+        close (out);
+        execvp (argv[0], const_cast<char *const *> (argv));
+        _exit (127);
+      }
+    close (out);
+    if (pid < 0)
+      {
+        unlink (fileName.c_str ());
+        return false;
+      }
+    Stream stream;
+    stream.fifo = fileName;
+    stream.pid = pid;
+    m_streams.push_back (stream);
+    return true;
+  }
+
+  /**
+   * Wait for every compressor to finish and remove the FIFOs.
+   *
+   * \return the number of compressors that did not exit cleanly
+   */
+  uint32_t Wait (void)
+  {
+    uint32_t failed = 0;
+    for (std::vector<Stream>::iterator i = m_streams.begin (); i != m_streams.end (); ++i)
+      {
+        // a FIFO that was never opened for writing would leave its
+        // compressor blocked in open (); open and close it once so that
+        // the compressor sees end of file instead
+        int fd = open (i->fifo.c_str (), O_WRONLY | O_NONBLOCK);
+        if (fd >= 0)
+          {
+            close (fd);
+          }
+        unlink (i->fifo.c_str ());
+
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid (i->pid, &status, 0)) < 0 && errno == EINTR)
+          {
+          }
+        if (pid < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+          {
+            failed++;
+          }
+      }
+    m_streams.clear ();
+    return failed;
+  }
+
+private:
+  struct Stream
+  {
+    std::string fifo;
+    pid_t pid;
+  };
+
+  Codec m_codec;
+  std::vector<Stream> m_streams;
+};
+
+} // namespace ns3
+
+#endif /* MANET_COMPRESSED_TRACE_H */
@@ -0,0 +1,171 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_FLOW_EXPORT_H
+#define MANET_FLOW_EXPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/flow-monitor-module.h"
+#include "manet-metrics-writer.h"
+
+namespace ns3 {
+
+/**
+ * Writes FlowMonitor statistics as they accumulate instead of once at the
+ * end of the run.
+ *
+ * Every interval, lost packets are checked and one row is written for
+ * each flow whose counters moved since the previous interval:
+ *
+ *   SimulationSecond,FlowId,Source,Destination,SourcePort,
+ *   DestinationPort,Protocol,TxPackets,TxBytes,RxPackets,RxBytes,
+ *   DelaySum,JitterSum,LostPackets
+ *
+ * All counters are deltas over the interval (delay and jitter sums in
+ * seconds).  Only the cumulative counters of the previous interval are
+ * kept per flow.
+ *
+ * FlowMonitor itself still keeps its per-flow histograms; with
+ * SetCoarseHistograms () they are reduced to a handful of bins so that
+ * a long run does not grow them.
+ */
+class FlowExporter
+{
+public:
+  FlowExporter ()
+    : m_interval (Seconds (1.0))
+  {
+  }
+
+  /// Use 1 s delay and jitter bins and 64 KiB packet size bins.
+  static void SetCoarseHistograms (FlowMonitorHelper &helper)
+  {
+    helper.SetMonitorAttribute ("DelayBinWidth", DoubleValue (1.0));
+    helper.SetMonitorAttribute ("JitterBinWidth", DoubleValue (1.0));
+    helper.SetMonitorAttribute ("PacketSizeBinWidth", DoubleValue (65536));
+  }
+
+  /**
+   * Start exporting.  The writer must be open; its flush policy applies.
+   *
+   * \param monitor the monitor to read, installed on all nodes
+   * \param classifier its IPv4 classifier, for the flow 5-tuples
+   * \param interval time between two exports
+   */
+  void Start (Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier, MetricsWriter *writer, Time interval)
+  {
+    m_monitor = monitor;
+    m_classifier = classifier;
+    m_writer = writer;
+    m_interval = interval;
+    m_event = Simulator::Schedule (interval, &FlowExporter::Export, this);
+  }
+
+  /// Export the time since the last export, e.g. at the end of the run.
+  void Export (void)
+  {
+    m_event.Cancel ();
+    double now = Simulator::Now ().GetSeconds ();
+    m_monitor->CheckForLostPackets ();
+    const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+    for (FlowMonitor::FlowStatsContainerCI i = stats.begin (); i != stats.end (); ++i)
+      {
+        if (i->first >= m_last.size ())
+          {
+            m_last.resize (i->first + 1);
+          }
+        Snapshot &last = m_last[i->first];
+        const FlowMonitor::FlowStats &s = i->second;
+        if (s.txPackets == last.txPackets && s.rxPackets == last.rxPackets && s.lostPackets == last.lostPackets)
+          {
+            continue;
+          }
+        Ipv4FlowClassifier::FiveTuple t = m_classifier->FindFlow (i->first);
+        m_writer->AddDouble (now)
+          .AddUint (i->first)
+          .AddString (FormatAddress (t.sourceAddress))
+          .AddString (FormatAddress (t.destinationAddress))
+          .AddUint (t.sourcePort)
+          .AddUint (t.destinationPort)
+          .AddUint (t.protocol)
+          .AddUint (s.txPackets - last.txPackets)
+          .AddUint (s.txBytes - last.txBytes)
+          .AddUint (s.rxPackets - last.rxPackets)
+          .AddUint (s.rxBytes - last.rxBytes)
+          .AddDouble ((s.delaySum - last.delaySum).GetSeconds ())
+          .AddDouble ((s.jitterSum - last.jitterSum).GetSeconds ())
+          .AddUint (s.lostPackets - last.lostPackets);
+        m_writer->EndRow (now);
+
+        last.txPackets = s.txPackets;
+        last.txBytes = s.txBytes;
+        last.rxPackets = s.rxPackets;
+        last.rxBytes = s.rxBytes;
+        last.delaySum = s.delaySum;
+        last.jitterSum = s.jitterSum;
+        last.lostPackets = s.lostPackets;
+      }
+    m_event = Simulator::Schedule (m_interval, &FlowExporter::Export, this);
+  }
+
+  /// Stop the periodic export, without a final one.
+  void Stop (void)
+  {
+    m_event.Cancel ();
+  }
+
+private:
+  struct Snapshot
+  {
+    Snapshot ()
+      : txPackets (0),
+        txBytes (0),
+        rxPackets (0),
+        rxBytes (0),
+        lostPackets (0)
+    {
+    }
+    uint32_t txPackets;
+    uint64_t txBytes;
+    uint32_t rxPackets;
+    uint64_t rxBytes;
+    Time delaySum;
+    Time jitterSum;
+    uint32_t lostPackets;
+  };
+
+  static std::string FormatAddress (Ipv4Address address)
+  {
+    char buf[16];
+    uint32_t a = address.Get ();
+    std::snprintf (buf, sizeof (buf), "%u.%u.%u.%u", a >> 24, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+    return buf;
+  }
+
+  Ptr<FlowMonitor> m_monitor;
+  Ptr<Ipv4FlowClassifier> m_classifier;
+  MetricsWriter *m_writer;
+  Time m_interval;
+  EventId m_event;
+  std::vector<Snapshot> m_last;
+};
+
+} // namespace ns3
+
+#endif /* MANET_FLOW_EXPORT_H */
@@ -0,0 +1,136 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_GOODPUT_H
+#define MANET_GOODPUT_H
+
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "manet-latency.h"
+#include "manet-metrics-writer.h"
+
+namespace ns3 {
+
+/**
+ * Application bytes delivered to the sinks, in total and per flow.
+ *
+ * Rx () is bound to the Rx trace of every sink application.  The bytes
+ * of a received packet are charged to flows by the LatencyTag byte tags
+ * the sources put on them, so a sink shared by several flows, or a TCP
+ * segment carrying the end of one application packet and the start of
+ * the next, is split exactly; untagged bytes only count in the total.
+ * The per-flow counters are a vector indexed by flow id, sized once by
+ * SetFlows ().
+ */
+class GoodputRecorder
+{
+public:
+  GoodputRecorder ()
+    : m_packets (0),
+      m_bytes (0)
+  {
+  }
+
+  void SetFlows (uint32_t nFlows)
+  {
+    m_flowBytes.assign (nFlows, 0);
+  }
+
+  /// Bind to the Rx trace of the sink applications.
+  static void Rx (GoodputRecorder *self, Ptr<const Packet> packet, const Address &from)
+  {
+    self->m_packets++;
+    self->m_bytes += packet->GetSize ();
+    ByteTagIterator i = packet->GetByteTagIterator ();
+    while (i.HasNext ())
+      {
+        ByteTagIterator::Item item = i.Next ();
+        if (item.GetTypeId () != LatencyTag::GetTypeId ())
+          {
+            continue;
+          }
+        LatencyTag tag;
+        item.GetTag (tag);
+        if (tag.flow < self->m_flowBytes.size ())
+          {
+            self->m_flowBytes[tag.flow] += item.GetEnd () - item.GetStart ();
+          }
+      }
+  }
+
+  /// \return the packets received by the sinks in the current interval
+  uint64_t GetPackets (void) const
+  {
+    return m_packets;
+  }
+
+  /// \return the bytes received by the sinks in the current interval
+  uint64_t GetBytes (void) const
+  {
+    return m_bytes;
+  }
+
+  uint32_t GetNFlows (void) const
+  {
+    return m_flowBytes.size ();
+  }
+
+  /// \return the bytes of flow received in the current interval
+  uint64_t GetFlowBytes (uint32_t flow) const
+  {
+    return m_flowBytes[flow];
+  }
+
+  /**
+   * Write one row per flow with bytes in this interval
+   * (FlowId,RxBytes,Goodput after the time column, goodput in kb/s) and
+   * reset all the counters.
+   *
+   * \param interval the length of the interval in seconds
+   */
+  void EndInterval (MetricsWriter &writer, double now, double interval)
+  {
+    for (uint32_t i = 0; i < m_flowBytes.size (); i++)
+      {
+        uint64_t bytes = m_flowBytes[i];
+        if (bytes == 0)
+          {
+            continue;
+          }
+        if (writer.IsOpen ())
+          {
+            writer.AddDouble (now)
+              .AddUint (i)
+              .AddUint (bytes)
+              .AddDouble (bytes * 8.0 / 1000 / interval);
+            writer.EndRow (now);
+          }
+        m_flowBytes[i] = 0;
+      }
+    m_packets = 0;
+    m_bytes = 0;
+  }
+
+private:
+  uint64_t m_packets;
+  uint64_t m_bytes;
+  std::vector<uint64_t> m_flowBytes;
+};
+
+} // namespace ns3
+
+#endif /* MANET_GOODPUT_H */
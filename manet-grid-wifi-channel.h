@@ -0,0 +1,395 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_GRID_WIFI_CHANNEL_H
+#define MANET_GRID_WIFI_CHANNEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/yans-wifi-channel.h"
+#include "ns3/yans-wifi-phy.h"
+#include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-utils.h"
+
+namespace ns3 {
+
+/**
+ * YansWifiChannel that only delivers a frame to the PHYs that can detect
+ * it.
+ *
+ * YansWifiChannel::Send schedules a receive event, with a packet copy,
+ * for every other PHY on the channel.  This channel keeps the PHYs in a
+ * uniform grid of their positions instead, and on each transmission only
+ * visits the cells within the distance at which the Friis model set with
+ * SetFriisModel () still predicts a received power above the lower of
+ * the PHYs' energy detection and CCA mode 1 thresholds (minus
+ * RangeMargin).  Every PHY inside that distance gets exactly the event
+ * YansWifiChannel would have scheduled, in the same order, so results
+ * only differ for signals too weak to be detected.
+ *
+ * Static nodes are bucketed once.  Moving nodes are re-bucketed on each
+ * course change and every RefreshInterval; in between, the scanned
+ * distance is widened by how far the fastest node may have moved.
+ *
+ * The index is built on the first transmission, once the PHYs have their
+ * devices and the nodes their mobility models.  The PHYs must be
+ * GridYansWifiPhy (see GridYansWifiPhyHelper), since YansWifiChannel::Send
+ * cannot be overridden.
+ */
+class GridYansWifiChannel : public YansWifiChannel
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::GridYansWifiChannel")
+      .SetParent<YansWifiChannel> ()
+      .SetGroupName ("Wifi")
+      .AddConstructor<GridYansWifiChannel> ()
+      .AddAttribute ("RangeMargin",
+                     "Extra path loss budget (dB) added when computing the detection range.",
+                     DoubleValue (3.0),
+                     MakeDoubleAccessor (&GridYansWifiChannel::m_marginDb),
+                     MakeDoubleChecker<double> (0.0))
+      .AddAttribute ("RefreshInterval",
+                     "How often moving nodes are re-bucketed.",
+                     TimeValue (Seconds (1.0)),
+                     MakeTimeAccessor (&GridYansWifiChannel::m_refreshInterval),
+                     MakeTimeChecker ())
+    ;
+    return tid;
+  }
+
+  GridYansWifiChannel ()
+    : m_marginDb (3.0),
+      m_cellSize (0),
+      m_maxSpeed (0)
+  {
+  }
+
+  void SetPropagationLossModel (Ptr<PropagationLossModel> loss)
+  {
+    YansWifiChannel::SetPropagationLossModel (loss);
+    m_loss = loss;
+  }
+
+  void SetPropagationDelayModel (Ptr<PropagationDelayModel> delay)
+  {
+    YansWifiChannel::SetPropagationDelayModel (delay);
+    m_delay = delay;
+  }
+
+  /// The Friis model whose parameters bound the detection range.
+  void SetFriisModel (Ptr<FriisPropagationLossModel> friis)
+  {
+    m_friis = friis;
+  }
+
+  /// YansWifiChannel::Send restricted to the PHYs in detection range.
+  void SendNearby (Ptr<YansWifiPhy> sender, Ptr<const Packet> packet, double txPowerDbm, Time duration)
+  {
+    if (m_entries.size () != GetNDevices ())
+      {
+        BuildIndex ();
+      }
+    Time now = Simulator::Now ();
+    if (now - m_lastRefresh >= m_refreshInterval)
+      {
+        Refresh ();
+      }
+
+    Ptr<MobilityModel> senderMobility = sender->GetMobility ();
+    NS_ASSERT (senderMobility != 0);
+    Vector senderPosition = senderMobility->GetPosition ();
+    double range = GetRange (txPowerDbm);
+    if (range < 0)
+      {
+        return;
+      }
+    double scan = range + m_maxSpeed * (now - m_lastRefresh).GetSeconds ();
+    int64_t reach = std::ceil (scan / m_cellSize);
+    int64_t cx = CellCoordinate (senderPosition.x);
+    int64_t cy = CellCoordinate (senderPosition.y);
+
+    m_candidates.clear ();
+    for (int64_t x = cx - reach; x <= cx + reach; x++)
+      {
+        for (int64_t y = cy - reach; y <= cy + reach; y++)
+          {
+            std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> >::const_iterator cell =
+              m_cells.find (std::make_pair (x, y));
+            if (cell == m_cells.end ())
+              {
+                continue;
+              }
+            for (std::vector<uint32_t>::const_iterator i = cell->second.begin (); i != cell->second.end (); ++i)
+              {
+                const Entry &entry = m_entries[*i];
+                if (entry.phy != sender
+                    && entry.mobility->GetDistanceFrom (senderMobility) <= range)
+                  {
+                    m_candidates.push_back (*i);
+                  }
+              }
+          }
+      }
+    // same order as YansWifiChannel, for identical event ordering
+    std::sort (m_candidates.begin (), m_candidates.end ());
+
+    for (std::vector<uint32_t>::const_iterator i = m_candidates.begin (); i != m_candidates.end (); ++i)
+      {
+        const Entry &entry = m_entries[*i];
+        if (entry.phy->GetChannelNumber () != sender->GetChannelNumber ())
+          {
+            continue;
+          }
+        Time delay = m_delay->GetDelay (senderMobility, entry.mobility);
+        double rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility, entry.mobility);
+        Ptr<Packet> copy = packet->Copy ();
+        Simulator::ScheduleWithContext (entry.node, delay, &GridYansWifiChannel::Receive,
+                                        entry.phy, copy, rxPowerDbm, entry.rxSensitivityDbm, duration);
+      }
+  }
+
+private:
+  struct Entry
+  {
+    Ptr<YansWifiPhy> phy;
+    Ptr<MobilityModel> mobility;
+    uint32_t node;
+    std::pair<int64_t, int64_t> cell;
+    double speed;
+    double rxSensitivityDbm;   ///< -infinity if the PHY has no RxSensitivity
+  };
+
+  virtual void DoDispose (void)
+  {
+    DisconnectCourseChanges ();
+    m_entries.clear ();
+    m_cells.clear ();
+    m_byMobility.clear ();
+    m_loss = 0;
+    m_delay = 0;
+    m_friis = 0;
+    YansWifiChannel::DoDispose ();
+  }
+
+  static void Receive (Ptr<YansWifiPhy> phy, Ptr<Packet> packet, double rxPowerDbm, double rxSensitivityDbm,
+                       Time duration)
+  {
+    // as YansWifiChannel::Receive, which drops signals below the
+    // RxSensitivity of the PHY in the ns-3 releases that have it
+    if (rxPowerDbm + phy->GetRxGain () < rxSensitivityDbm)
+      {
+        return;
+      }
+    phy->StartReceivePreamble (packet, DbmToW (rxPowerDbm + phy->GetRxGain ()), duration);
+  }
+
+  int64_t CellCoordinate (double v) const
+  {
+    return std::floor (v / m_cellSize);
+  }
+
+  /// \return the largest distance at which txPowerDbm can be detected
+  double GetRange (double txPowerDbm) const
+  {
+    double budget = txPowerDbm + m_maxRxGain - m_minThreshold + m_marginDb;
+    if (budget < m_minLoss)
+      {
+        return -1;
+      }
+    return m_lambda / (4 * M_PI * std::sqrt (m_systemLoss)) * std::pow (10.0, budget / 20.0);
+  }
+
+  void BuildIndex (void)
+  {
+    NS_ABORT_MSG_IF (m_friis == 0, "GridYansWifiChannel needs SetFriisModel ()");
+    NS_ABORT_MSG_IF (m_loss == 0 || m_delay == 0, "GridYansWifiChannel needs its loss and delay models set on itself");
+    DoubleValue frequency;
+    DoubleValue systemLoss;
+    DoubleValue minLoss;
+    m_friis->GetAttribute ("Frequency", frequency);
+    m_friis->GetAttribute ("SystemLoss", systemLoss);
+    m_friis->GetAttribute ("MinLoss", minLoss);
+    m_lambda = 299792458.0 / frequency.Get ();
+    m_systemLoss = systemLoss.Get ();
+    m_minLoss = minLoss.Get ();
+
+    DisconnectCourseChanges ();
+    m_entries.clear ();
+    m_byMobility.clear ();
+
+    m_maxRxGain = -1e9;
+    m_minThreshold = 1e9;
+    double maxTxPowerDbm = -1e9;
+    for (uint32_t i = 0; i < GetNDevices (); i++)
+      {
+        Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice> (GetDevice (i));
+        NS_ABORT_MSG_IF (device == 0, "GridYansWifiChannel only supports WifiNetDevice");
+        Entry entry;
+        entry.phy = DynamicCast<YansWifiPhy> (device->GetPhy ());
+        entry.mobility = entry.phy->GetMobility ();
+        NS_ABORT_MSG_IF (entry.mobility == 0, "GridYansWifiChannel needs a mobility model on every node");
+        entry.node = device->GetNode ()->GetId ();
+        entry.speed = 0;
+        DoubleValue sensitivity;
+        entry.rxSensitivityDbm = entry.phy->GetAttributeFailSafe ("RxSensitivity", sensitivity)
+          ? sensitivity.Get () : -std::numeric_limits<double>::infinity ();
+        m_byMobility[PeekPointer (entry.mobility)] = m_entries.size ();
+        m_entries.push_back (entry);
+        entry.mobility->TraceConnectWithoutContext ("CourseChange", MakeCallback (&GridYansWifiChannel::CourseChanged, this));
+
+        m_maxRxGain = std::max (m_maxRxGain, entry.phy->GetRxGain ());
+        m_minThreshold = std::min (m_minThreshold, std::min (entry.phy->GetEdThreshold (),
+                                                             entry.phy->GetCcaMode1Threshold ()));
+        if (entry.rxSensitivityDbm > -std::numeric_limits<double>::infinity ())
+          {
+            m_minThreshold = std::min (m_minThreshold, entry.rxSensitivityDbm);
+          }
+        maxTxPowerDbm = std::max (maxTxPowerDbm, entry.phy->GetTxPowerEnd () + entry.phy->GetTxGain ());
+      }
+
+    // one cell per detection range, so that most scans visit 3x3 cells
+    m_cellSize = std::max (GetRange (maxTxPowerDbm), 1.0);
+    Refresh ();
+  }
+
+  void DisconnectCourseChanges (void)
+  {
+    for (std::vector<Entry>::iterator i = m_entries.begin (); i != m_entries.end (); ++i)
+      {
+        i->mobility->TraceDisconnectWithoutContext ("CourseChange", MakeCallback (&GridYansWifiChannel::CourseChanged, this));
+      }
+  }
+
+  /// Re-bucket every entry at its current position.
+  void Refresh (void)
+  {
+    m_cells.clear ();
+    m_maxSpeed = 0;
+    for (uint32_t i = 0; i < m_entries.size (); i++)
+      {
+        Entry &entry = m_entries[i];
+        Vector position = entry.mobility->GetPosition ();
+        entry.cell = std::make_pair (CellCoordinate (position.x), CellCoordinate (position.y));
+        entry.speed = CalculateDistance (entry.mobility->GetVelocity (), Vector (0, 0, 0));
+        m_cells[entry.cell].push_back (i);
+        m_maxSpeed = std::max (m_maxSpeed, entry.speed);
+      }
+    m_lastRefresh = Simulator::Now ();
+  }
+
+  void CourseChanged (Ptr<const MobilityModel> mobility)
+  {
+    std::map<const MobilityModel *, uint32_t>::const_iterator found = m_byMobility.find (PeekPointer (mobility));
+    if (found == m_byMobility.end ())
+      {
+        return;
+      }
+    Entry &entry = m_entries[found->second];
+    Vector position = mobility->GetPosition ();
+    std::pair<int64_t, int64_t> cell (CellCoordinate (position.x), CellCoordinate (position.y));
+    if (cell != entry.cell)
+      {
+        std::vector<uint32_t> &old = m_cells[entry.cell];
+        old.erase (std::find (old.begin (), old.end (), found->second));
+        m_cells[cell].push_back (found->second);
+        entry.cell = cell;
+      }
+    entry.speed = CalculateDistance (mobility->GetVelocity (), Vector (0, 0, 0));
+    m_maxSpeed = std::max (m_maxSpeed, entry.speed);
+  }
+
+  double m_marginDb;
+  Time m_refreshInterval;
+  Ptr<PropagationLossModel> m_loss;
+  Ptr<PropagationDelayModel> m_delay;
+  Ptr<FriisPropagationLossModel> m_friis;
+  double m_lambda;
+  double m_systemLoss;
+  double m_minLoss;
+  double m_maxRxGain;
+  double m_minThreshold;
+  double m_cellSize;
+  double m_maxSpeed;
+  Time m_lastRefresh;
+  std::vector<Entry> m_entries;
+  std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> > m_cells;
+  std::map<const MobilityModel *, uint32_t> m_byMobility;
+  std::vector<uint32_t> m_candidates;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (GridYansWifiChannel);
+
+/**
+ * YansWifiPhy that transmits through GridYansWifiChannel::SendNearby
+ * when it is attached to a GridYansWifiChannel.
+ */
+class GridYansWifiPhy : public YansWifiPhy
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::GridYansWifiPhy")
+      .SetParent<YansWifiPhy> ()
+      .SetGroupName ("Wifi")
+      .AddConstructor<GridYansWifiPhy> ()
+    ;
+    return tid;
+  }
+
+  virtual void StartTx (Ptr<Packet> packet, WifiTxVector txVector, Time txDuration)
+  {
+    Ptr<GridYansWifiChannel> channel = DynamicCast<GridYansWifiChannel> (GetChannel ());
+    if (channel == 0)
+      {
+        YansWifiPhy::StartTx (packet, txVector, txDuration);
+        return;
+      }
+    channel->SendNearby (this, packet, GetPowerDbm (txVector.GetTxPowerLevel ()) + GetTxGain (), txDuration);
+  }
+};
+
+NS_OBJECT_ENSURE_REGISTERED (GridYansWifiPhy);
+
+/**
+ * YansWifiPhyHelper::Default () creating GridYansWifiPhy instances, or
+ * plain YansWifiPhy ones when grid is false.
+ */
+class GridYansWifiPhyHelper : public YansWifiPhyHelper
+{
+public:
+  explicit GridYansWifiPhyHelper (bool grid = true)
+  {
+    if (grid)
+      {
+        m_phy.SetTypeId ("ns3::GridYansWifiPhy");
+      }
+    SetErrorRateModel ("ns3::NistErrorRateModel");
+  }
+};
+
+} // namespace ns3
+
+#endif /* MANET_GRID_WIFI_CHANNEL_H */
@@ -0,0 +1,323 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_LADDER_SCHEDULER_H
+#define MANET_LADDER_SCHEDULER_H
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/scheduler.h"
+
+namespace ns3 {
+
+/**
+ * Ladder queue event scheduler (Tang, Goh and Thng, "Ladder Queue: An
+ * O(1) Priority Queue Structure for Large-Scale Discrete Event
+ * Simulation", ACM TOMACS 2005).
+ *
+ * Events far in the future are appended, unsorted, to the top list.  When
+ * the near future runs out, the top list is spread over the buckets of a
+ * rung, each bucket covering an equal slice of time; the earliest
+ * non-empty bucket is then sorted into the bottom list, which events are
+ * dequeued from, or, when it holds more than THRESHOLD events, spread
+ * over a finer rung below.  New events go to the top list, the rung
+ * whose unconsumed range covers them, or the bottom list, so that only
+ * the few events of the bottom list are ever kept sorted.
+ *
+ * Ties are broken on the event uid, as by the other ns-3 schedulers.
+ *
+ * Remove () finds a top list event through an index of the top list by
+ * uid, built by the first such Remove () and kept until the top list is
+ * next spread over a rung, so that runs which never remove events do not
+ * pay for it; a bottom list event through a binary search, and a rung
+ * event by scanning its bucket, which holds few events.
+ */
+class LadderScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::LadderScheduler")
+      .SetParent<Scheduler> ()
+      .SetGroupName ("Core")
+      .AddConstructor<LadderScheduler> ()
+    ;
+    return tid;
+  }
+
+  LadderScheduler ()
+    : m_size (0),
+      m_topStart (0),
+      m_topMin (std::numeric_limits<uint64_t>::max ()),
+      m_topMax (0),
+      m_topIndexed (false),
+      m_rungs (MAX_RUNGS),
+      m_nRungs (0)
+  {
+  }
+
+  virtual void Insert (const Event &ev)
+  {
+    m_size++;
+    if (m_nRungs == 0 && m_top.empty ())
+      {
+        // nothing in the future but the bottom list: later events can go
+        // straight to the top, as uids only grow
+        m_topStart = m_bottom.empty () ? 0 : m_bottom.front ().key.m_ts;
+      }
+    uint64_t ts = ev.key.m_ts;
+    if (ts >= m_topStart)
+      {
+        if (m_topIndexed)
+          {
+            m_topIndex[ev.key.m_uid] = m_top.size ();
+          }
+        m_top.push_back (ev);
+        m_topMin = std::min (m_topMin, ts);
+        m_topMax = std::max (m_topMax, ts);
+        return;
+      }
+    for (uint32_t i = 0; i < m_nRungs; i++)
+      {
+        Rung &rung = m_rungs[i];
+        if (ts >= rung.GetCurrentStart ())
+          {
+            rung.buckets[rung.GetBucket (ts)].push_back (ev);
+            rung.count++;
+            return;
+          }
+      }
+    m_bottom.insert (std::upper_bound (m_bottom.begin (), m_bottom.end (), ev, &Later), ev);
+  }
+
+  virtual bool IsEmpty (void) const
+  {
+    return m_size == 0;
+  }
+
+  virtual Event PeekNext (void) const
+  {
+    Refill ();
+    return m_bottom.back ();
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    Refill ();
+    Event ev = m_bottom.back ();
+    m_bottom.pop_back ();
+    m_size--;
+    return ev;
+  }
+
+  virtual void Remove (const Event &ev)
+  {
+    m_size--;
+    uint64_t ts = ev.key.m_ts;
+    if (ts >= m_topStart)
+      {
+        // the top bounds stay valid, if loose
+        EraseTop (ev);
+        return;
+      }
+    for (uint32_t i = 0; i < m_nRungs; i++)
+      {
+        Rung &rung = m_rungs[i];
+        if (ts >= rung.GetCurrentStart ())
+          {
+            Erase (rung.buckets[rung.GetBucket (ts)], ev);
+            rung.count--;
+            return;
+          }
+      }
+    std::vector<Event>::iterator i = std::lower_bound (m_bottom.begin (), m_bottom.end (), ev, &Later);
+    if (i != m_bottom.end () && i->key.m_uid == ev.key.m_uid)
+      {
+        m_bottom.erase (i);
+        return;
+      }
+    NS_FATAL_ERROR ("LadderScheduler::Remove: event " << ev.key.m_uid << " not found");
+  }
+
+private:
+  enum
+  {
+    THRESHOLD = 50,  ///< largest bucket sorted into the bottom list
+    MAX_RUNGS = 8
+  };
+
+  struct Rung
+  {
+    uint64_t start;
+    uint64_t width;
+    uint32_t current;   ///< first bucket not yet consumed
+    uint32_t nBuckets;
+    uint32_t count;
+    std::vector<std::vector<Event> > buckets;
+
+    uint64_t GetCurrentStart (void) const
+    {
+      return start + current * width;
+    }
+
+    uint32_t GetBucket (uint64_t ts) const
+    {
+      return (ts - start) / width;
+    }
+  };
+
+  /// bottom list order: latest first, so that the next event is at the back
+  static bool Later (const Event &a, const Event &b)
+  {
+    return b.key < a.key;
+  }
+
+  static void Erase (std::vector<Event> &events, const Event &ev)
+  {
+    for (std::vector<Event>::iterator i = events.begin (); i != events.end (); ++i)
+      {
+        if (i->key.m_uid == ev.key.m_uid)
+          {
+            *i = events.back ();
+            events.pop_back ();
+            return;
+          }
+      }
+    NS_FATAL_ERROR ("LadderScheduler::Remove: event " << ev.key.m_uid << " not found");
+  }
+
+  void EraseTop (const Event &ev)
+  {
+    if (!m_topIndexed)
+      {
+        for (uint32_t i = 0; i < m_top.size (); i++)
+          {
+            m_topIndex[m_top[i].key.m_uid] = i;
+          }
+        m_topIndexed = true;
+      }
+    std::unordered_map<uint32_t, uint32_t>::iterator found = m_topIndex.find (ev.key.m_uid);
+    if (found == m_topIndex.end ())
+      {
+        NS_FATAL_ERROR ("LadderScheduler::Remove: event " << ev.key.m_uid << " not found");
+      }
+    uint32_t index = found->second;
+    m_topIndex.erase (found);
+    if (index + 1 < m_top.size ())
+      {
+        m_top[index] = m_top.back ();
+        m_topIndex[m_top[index].key.m_uid] = index;
+      }
+    m_top.pop_back ();
+  }
+
+  /// Start a rung below the current ones; its buckets keep their storage.
+  Rung &NewRung (uint64_t start, uint64_t width, uint32_t nBuckets) const
+  {
+    Rung &rung = m_rungs[m_nRungs++];
+    rung.start = start;
+    rung.width = width;
+    rung.current = 0;
+    rung.nBuckets = nBuckets;
+    rung.count = 0;
+    if (rung.buckets.size () < nBuckets)
+      {
+        rung.buckets.resize (nBuckets);
+      }
+    return rung;
+  }
+
+  /// Make sure the bottom list holds the next event, if any.
+  void Refill (void) const
+  {
+    NS_ASSERT (m_size > 0);
+    while (m_bottom.empty ())
+      {
+        if (m_nRungs == 0)
+          {
+            NS_ASSERT (!m_top.empty ());
+            uint64_t width = (m_topMax - m_topMin) / m_top.size () + 1;
+            uint32_t nBuckets = (m_topMax - m_topMin) / width + 1;
+            Rung &rung = NewRung (m_topMin, width, nBuckets);
+            for (std::vector<Event>::const_iterator i = m_top.begin (); i != m_top.end (); ++i)
+              {
+                rung.buckets[rung.GetBucket (i->key.m_ts)].push_back (*i);
+              }
+            rung.count = m_top.size ();
+            m_topStart = rung.start + nBuckets * width;
+            m_top.clear ();
+            m_topIndex.clear ();
+            m_topIndexed = false;
+            m_topMin = std::numeric_limits<uint64_t>::max ();
+            m_topMax = 0;
+            continue;
+          }
+
+        Rung &rung = m_rungs[m_nRungs - 1];
+        if (rung.count == 0)
+          {
+            m_nRungs--;
+            continue;
+          }
+        while (rung.buckets[rung.current].empty ())
+          {
+            rung.current++;
+          }
+        std::vector<Event> &bucket = rung.buckets[rung.current];
+        uint64_t bucketStart = rung.GetCurrentStart ();
+        rung.current++;
+        rung.count -= bucket.size ();
+        if (bucket.size () > THRESHOLD && rung.width > 1 && m_nRungs < MAX_RUNGS)
+          {
+            uint64_t width = (rung.width + bucket.size () - 1) / bucket.size ();
+            uint32_t nBuckets = (rung.width + width - 1) / width;
+            Rung &child = NewRung (bucketStart, width, nBuckets);
+            for (std::vector<Event>::const_iterator i = bucket.begin (); i != bucket.end (); ++i)
+              {
+                child.buckets[child.GetBucket (i->key.m_ts)].push_back (*i);
+              }
+            child.count = bucket.size ();
+            bucket.clear ();
+          }
+        else
+          {
+            m_bottom.swap (bucket);
+            std::sort (m_bottom.begin (), m_bottom.end (), &Later);
+          }
+      }
+  }
+
+  uint32_t m_size;
+  // PeekNext () may have to move events down the ladder
+  mutable uint64_t m_topStart;
+  mutable uint64_t m_topMin;
+  mutable uint64_t m_topMax;
+  mutable std::vector<Event> m_top;
+  mutable std::unordered_map<uint32_t, uint32_t> m_topIndex;   ///< uid to position in m_top
+  mutable bool m_topIndexed;
+  mutable std::vector<Rung> m_rungs;
+  mutable uint32_t m_nRungs;
+  mutable std::vector<Event> m_bottom;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LadderScheduler);
+
+} // namespace ns3
+
+#endif /* MANET_LADDER_SCHEDULER_H */
@@ -0,0 +1,333 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_LATENCY_H
+#define MANET_LATENCY_H
+
+#include <algorithm>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "manet-metrics-writer.h"
+
+namespace ns3 {
+
+/**
+ * Byte tag carried by every application packet: when and by which flow it
+ * was sent, its sequence number within the flow and its size.  Being a
+ * byte tag, it follows the packet's bytes through TCP segmentation and
+ * reassembly.
+ */
+class LatencyTag : public Tag
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::LatencyTag")
+      .SetParent<Tag> ()
+      .SetGroupName ("Network")
+      .AddConstructor<LatencyTag> ()
+    ;
+    return tid;
+  }
+
+  LatencyTag ()
+    : timeNs (0),
+      flow (0),
+      sequence (0),
+      size (0)
+  {
+  }
+
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return 8 + 4 + 4 + 4;
+  }
+
+  virtual void Serialize (TagBuffer i) const
+  {
+    i.WriteU64 (timeNs);
+    i.WriteU32 (flow);
+    i.WriteU32 (sequence);
+    i.WriteU32 (size);
+  }
+
+  virtual void Deserialize (TagBuffer i)
+  {
+    timeNs = i.ReadU64 ();
+    flow = i.ReadU32 ();
+    sequence = i.ReadU32 ();
+    size = i.ReadU32 ();
+  }
+
+  virtual void Print (std::ostream &os) const
+  {
+    os << "flow=" << flow << " seq=" << sequence << " sent=" << timeNs << "ns";
+  }
+
+  int64_t timeNs;
+  uint32_t flow;
+  uint32_t sequence;
+  uint32_t size;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LatencyTag);
+
+/**
+ * Log-linear histogram of nanosecond values, in the style of
+ * HdrHistogram: values below 128 get a bucket each, and every power of
+ * two above is split in 64 buckets, for a relative error below 1.6%.
+ * Values from about 78 hours up share the last bucket.  The bucket array
+ * has a fixed size, whatever is recorded.
+ */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram ()
+    : m_counts (BUCKETS, 0),
+      m_total (0),
+      m_max (0)
+  {
+  }
+
+  void Record (uint64_t value)
+  {
+    m_counts[GetBucket (value)]++;
+    m_total++;
+    m_max = std::max (m_max, value);
+  }
+
+  void Add (const LatencyHistogram &other)
+  {
+    for (uint32_t i = 0; i < BUCKETS; i++)
+      {
+        m_counts[i] += other.m_counts[i];
+      }
+    m_total += other.m_total;
+    m_max = std::max (m_max, other.m_max);
+  }
+
+  void Reset (void)
+  {
+    std::fill (m_counts.begin (), m_counts.end (), 0);
+    m_total = 0;
+    m_max = 0;
+  }
+
+  uint64_t GetCount (void) const
+  {
+    return m_total;
+  }
+
+  uint64_t GetMax (void) const
+  {
+    return m_max;
+  }
+
+  /**
+   * \return the highest value equivalent to the one at this percentile
+   *         (0 to 100), capped at the exact maximum; 0 when empty
+   */
+  uint64_t GetPercentile (double percentile) const
+  {
+    if (m_total == 0)
+      {
+        return 0;
+      }
+    uint64_t rank = std::max<uint64_t> (1, uint64_t (percentile / 100.0 * m_total + 0.5));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKETS; i++)
+      {
+        seen += m_counts[i];
+        if (seen >= rank)
+          {
+            return std::min (GetBucketEnd (i) - 1, m_max);
+          }
+      }
+    return m_max;
+  }
+
+private:
+  enum
+  {
+    LINEAR = 128,      ///< values recorded exactly
+    SUB_BUCKETS = 64,  ///< buckets per power of two above LINEAR
+    MAX_SHIFT = 41,
+    BUCKETS = LINEAR + MAX_SHIFT * SUB_BUCKETS
+  };
+
+  static uint32_t GetBucket (uint64_t value)
+  {
+    if (value < LINEAR)
+      {
+        return value;
+      }
+    uint32_t msb = 63 - __builtin_clzll (value);
+    uint32_t shift = msb - 6;
+    if (shift > MAX_SHIFT)
+      {
+        return BUCKETS - 1;
+      }
+    return LINEAR + (shift - 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+  }
+
+  /// \return the first value past bucket i
+  static uint64_t GetBucketEnd (uint32_t i)
+  {
+    if (i < LINEAR)
+      {
+        return i + 1;
+      }
+    uint32_t shift = (i - LINEAR) / SUB_BUCKETS + 1;
+    uint64_t top = (i - LINEAR) % SUB_BUCKETS + SUB_BUCKETS;
+    return (top + 1) << shift;
+  }
+
+  std::vector<uint32_t> m_counts;
+  uint64_t m_total;
+  uint64_t m_max;
+};
+
+/**
+ * End-to-end delay of the application packets of a set of flows.
+ *
+ * Tx () stamps each packet with a LatencyTag when the source application
+ * sends it, and Rx () records the delay of a packet into its flow's
+ * histogram, and into the one of all flows, once the sink has received
+ * all of its bytes.  The histograms cover one interval; EndInterval ()
+ * writes and resets them.
+ */
+class LatencyRecorder
+{
+public:
+  void SetFlows (uint32_t nFlows)
+  {
+    m_flows.assign (nFlows, Flow ());
+  }
+
+  /// Bind to the Tx trace of the source application of flow.
+  static void Tx (LatencyRecorder *self, uint32_t flow, Ptr<const Packet> packet)
+  {
+    LatencyTag tag;
+    tag.timeNs = Simulator::Now ().GetNanoSeconds ();
+    tag.flow = flow;
+    tag.sequence = self->m_flows[flow].nextSequence++;
+    tag.size = packet->GetSize ();
+    packet->AddByteTag (tag);
+  }
+
+  /// Bind to the Rx trace of the sink applications.
+  static void Rx (LatencyRecorder *self, Ptr<const Packet> packet, const Address &from)
+  {
+    int64_t now = Simulator::Now ().GetNanoSeconds ();
+    ByteTagIterator i = packet->GetByteTagIterator ();
+    while (i.HasNext ())
+      {
+        ByteTagIterator::Item item = i.Next ();
+        if (item.GetTypeId () != LatencyTag::GetTypeId ())
+          {
+            continue;
+          }
+        LatencyTag tag;
+        item.GetTag (tag);
+        if (tag.flow >= self->m_flows.size ())
+          {
+            continue;
+          }
+        // a packet may arrive in several pieces, and the sink may get
+        // several packets at once; the delay counts up to the last byte
+        Flow &flow = self->m_flows[tag.flow];
+        if (tag.sequence != flow.rxSequence)
+          {
+            flow.rxSequence = tag.sequence;
+            flow.rxBytes = 0;
+          }
+        flow.rxBytes += item.GetEnd () - item.GetStart ();
+        if (flow.rxBytes >= tag.size)
+          {
+            flow.histogram.Record (now - tag.timeNs);
+            self->m_aggregate.Record (now - tag.timeNs);
+            flow.rxBytes = 0;
+            flow.rxSequence = NO_SEQUENCE;
+          }
+      }
+  }
+
+  /// \return the histogram of all flows over the current interval
+  const LatencyHistogram &GetAggregate (void) const
+  {
+    return m_aggregate;
+  }
+
+  /**
+   * Write one row per flow with packets in this interval
+   * (FlowId,Packets,DelayP50,DelayP95,DelayP99,DelayMax after the time
+   * column, delays in seconds) and reset the histograms.
+   */
+  void EndInterval (MetricsWriter &writer, double now)
+  {
+    for (uint32_t i = 0; i < m_flows.size (); i++)
+      {
+        LatencyHistogram &histogram = m_flows[i].histogram;
+        if (histogram.GetCount () == 0)
+          {
+            continue;
+          }
+        if (writer.IsOpen ())
+          {
+            writer.AddDouble (now)
+              .AddUint (i)
+              .AddUint (histogram.GetCount ())
+              .AddDouble (histogram.GetPercentile (50) / 1e9)
+              .AddDouble (histogram.GetPercentile (95) / 1e9)
+              .AddDouble (histogram.GetPercentile (99) / 1e9)
+              .AddDouble (histogram.GetMax () / 1e9);
+            writer.EndRow (now);
+          }
+        histogram.Reset ();
+      }
+    m_aggregate.Reset ();
+  }
+
+private:
+  static const uint32_t NO_SEQUENCE = 0xffffffff;
+
+  struct Flow
+  {
+    Flow ()
+      : nextSequence (0),
+        rxSequence (NO_SEQUENCE),
+        rxBytes (0)
+    {
+    }
+    uint32_t nextSequence;
+    uint32_t rxSequence;
+    uint32_t rxBytes;
+    LatencyHistogram histogram;
+  };
+
+  std::vector<Flow> m_flows;
+  LatencyHistogram m_aggregate;   ///< all flows, recorded along with them
+};
+
+} // namespace ns3
+
+#endif /* MANET_LATENCY_H */
@@ -0,0 +1,474 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_LIVE_METRICS_H
+#define MANET_LIVE_METRICS_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+
+namespace ns3 {
+
+/// The counters of a live metrics file, in file order.
+enum LiveMetric
+{
+  LIVE_SIM_TIME,          ///< simulated seconds (double)
+  LIVE_EVENTS,            ///< events executed
+  LIVE_EVENT_RATE,        ///< events per wall-clock second over the last interval (double)
+  LIVE_RX_PACKETS,        ///< application packets received
+  LIVE_RX_BYTES,          ///< application bytes received
+  LIVE_RECEIVE_RATE,      ///< kb/s received over the last interval (double)
+  LIVE_DROPS,             ///< packets dropped by IPv4 or the wifi MAC
+  LIVE_CONTROL_PACKETS,   ///< routing control packets sent
+  LIVE_CONTROL_BYTES,     ///< routing control bytes sent
+  LIVE_FINISHED,          ///< 1 once the simulation is over
+  LIVE_METRICS
+};
+
+inline const char *
+GetLiveMetricName (uint32_t metric)
+{
+  static const char *names[LIVE_METRICS] = {
+    "SimulationSecond", "Events", "EventRate", "RxPackets", "RxBytes", "ReceiveRate",
+    "Drops", "ControlPackets", "ControlBytes", "Finished"
+  };
+  return names[metric];
+}
+
+/// \return whether the value of metric is the bits of a double
+inline bool
+IsLiveMetricDouble (uint32_t metric)
+{
+  return metric == LIVE_SIM_TIME || metric == LIVE_EVENT_RATE || metric == LIVE_RECEIVE_RATE;
+}
+
+static const char LIVE_METRICS_MAGIC[8] = { 'M', 'L', 'I', 'V', 'E', 'M', '0', '1' };
+
+/**
+ * Live metrics file, in host byte order: a LiveMetricsHeader, then
+ * nMetrics words (see LiveMetric), then two words per flow, the bytes
+ * received so far and the goodput in kb/s over the last interval
+ * (double).
+ *
+ * The words are guarded by the sequence counter of the header, seqlock
+ * style: the writer makes it odd, updates the words and makes it even
+ * again, and a reader copies the words between two reads of the same
+ * even sequence.
+ */
+struct LiveMetricsHeader
+{
+  char magic[8];
+  uint32_t nMetrics;
+  uint32_t nFlows;
+  int32_t pid;          ///< of the simulation
+  uint32_t reserved;
+  std::atomic<uint64_t> sequence;
+};
+
+inline double
+LiveMetricsToDouble (uint64_t bits)
+{
+  double value;
+  std::memcpy (&value, &bits, sizeof (value));
+  return value;
+}
+
+/**
+ * Publishes the counters of the running simulation into a file mapped in
+ * memory, e.g. under /dev/shm, where any local process can read them at
+ * any rate (see LiveMetricsReader and manet-live-monitor).
+ *
+ * The counters are accumulated in the process with Add* () and turned
+ * into the words of the file by Publish (), once per interval, which
+ * copies them into the mapping when a file is open: a few dozen stores
+ * and no system call.  GetValues () gives the words of the last
+ * Publish () to other exporters.
+ */
+class LiveMetrics
+{
+public:
+  LiveMetrics ()
+    : m_fd (-1),
+      m_header (0),
+      m_values (0),
+      m_size (0),
+      m_rxPackets (0),
+      m_rxBytes (0),
+      m_intervalBytes (0),
+      m_drops (0),
+      m_controlPackets (0),
+      m_controlBytes (0),
+      m_lastEvents (0)
+  {
+  }
+
+  ~LiveMetrics ()
+  {
+    Close ();
+  }
+
+  /// Must be called before Open () and the run.
+  void SetFlows (uint32_t nFlows)
+  {
+    m_flowBytes.assign (nFlows, 0);
+    m_intervalFlowBytes.assign (nFlows, 0);
+    m_words.assign (LIVE_METRICS + 2 * size_t (nFlows), 0);
+    m_lastEvents = Simulator::GetEventCount ();
+    m_lastWall = std::chrono::steady_clock::now ();
+  }
+
+  /**
+   * Create fileName and map it.
+   *
+   * \return false if the file cannot be created
+   */
+  bool Open (const std::string &fileName)
+  {
+    Close ();
+    // a new file, so that readers of a previous one do not see it shrink
+    unlink (fileName.c_str ());
+    m_fd = open (fileName.c_str (), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (m_fd < 0)
+      {
+        return false;
+      }
+    m_size = sizeof (LiveMetricsHeader) + m_words.size () * sizeof (uint64_t);
+    void *mapping = MAP_FAILED;
+    if (ftruncate (m_fd, m_size) == 0)
+      {
+        mapping = mmap (0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+      }
+    if (mapping == MAP_FAILED)
+      {
+        close (m_fd);
+        m_fd = -1;
+        return false;
+      }
+    // a fresh file reads as zeros: sequence 0, no values yet
+    m_header = static_cast<LiveMetricsHeader *> (mapping);
+    m_values = reinterpret_cast<std::atomic<uint64_t> *> (m_header + 1);
+    m_header->nMetrics = LIVE_METRICS;
+    m_header->nFlows = m_flowBytes.size ();
+    m_header->pid = getpid ();
+    m_header->reserved = 0;
+    // the magic last, once the layout is valid
+    std::atomic_thread_fence (std::memory_order_release);
+    std::memcpy (m_header->magic, LIVE_METRICS_MAGIC, sizeof (m_header->magic));
+    return true;
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_header != 0;
+  }
+
+  /// Count the packets nodes drop in IPv4 and the wifi MACs.
+  void Install (NodeContainer nodes)
+  {
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        Ptr<Ipv4L3Protocol> ipv4 = (*i)->GetObject<Ipv4L3Protocol> ();
+        NS_ABORT_MSG_IF (ipv4 == 0, "LiveMetrics needs the internet stack installed");
+        ipv4->TraceConnectWithoutContext ("Drop", MakeBoundCallback (&LiveMetrics::Ipv4Drop, this));
+        for (uint32_t j = 0; j < (*i)->GetNDevices (); j++)
+          {
+            Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice> ((*i)->GetDevice (j));
+            if (device != 0)
+              {
+                device->GetMac ()->TraceConnectWithoutContext ("MacTxDrop",
+                                                               MakeBoundCallback (&LiveMetrics::MacDrop, this));
+              }
+          }
+      }
+  }
+
+  /// Add the application packets and bytes received in the current interval.
+  void AddReceived (uint64_t packets, uint64_t bytes)
+  {
+    m_rxPackets += packets;
+    m_rxBytes += bytes;
+    m_intervalBytes += bytes;
+  }
+
+  /// Add the routing control packets and bytes sent in the current interval.
+  void AddControl (uint64_t packets, uint64_t bytes)
+  {
+    m_controlPackets += packets;
+    m_controlBytes += bytes;
+  }
+
+  /// Add the bytes flow received in the current interval.
+  void AddFlowBytes (uint32_t flow, uint64_t bytes)
+  {
+    if (flow < m_flowBytes.size ())
+      {
+        m_flowBytes[flow] += bytes;
+        m_intervalFlowBytes[flow] += bytes;
+      }
+  }
+
+  /**
+   * Publish the counters and start a new interval.
+   *
+   * \param now the current simulated time in seconds
+   * \param interval the length of the interval in seconds
+   */
+  void Publish (double now, double interval)
+  {
+    uint64_t events = Simulator::GetEventCount ();
+    std::chrono::steady_clock::time_point wall = std::chrono::steady_clock::now ();
+    double elapsed = std::chrono::duration<double> (wall - m_lastWall).count ();
+
+    SetDouble (LIVE_SIM_TIME, now);
+    Set (LIVE_EVENTS, events);
+    SetDouble (LIVE_EVENT_RATE, elapsed > 0 ? (events - m_lastEvents) / elapsed : 0);
+    Set (LIVE_RX_PACKETS, m_rxPackets);
+    Set (LIVE_RX_BYTES, m_rxBytes);
+    SetDouble (LIVE_RECEIVE_RATE, m_intervalBytes * 8.0 / 1000 / interval);
+    Set (LIVE_DROPS, m_drops);
+    Set (LIVE_CONTROL_PACKETS, m_controlPackets);
+    Set (LIVE_CONTROL_BYTES, m_controlBytes);
+    for (uint32_t i = 0; i < m_flowBytes.size (); i++)
+      {
+        Set (LIVE_METRICS + 2 * i, m_flowBytes[i]);
+        SetDouble (LIVE_METRICS + 2 * i + 1, m_intervalFlowBytes[i] * 8.0 / 1000 / interval);
+        m_intervalFlowBytes[i] = 0;
+      }
+    Store ();
+
+    m_intervalBytes = 0;
+    m_lastEvents = events;
+    m_lastWall = wall;
+  }
+
+  /// \return the words of the last Publish (), in file order
+  const std::vector<uint64_t> &GetValues (void) const
+  {
+    return m_words;
+  }
+
+  /// Publish that the simulation is over.
+  void Finish (void)
+  {
+    if (!m_words.empty ())
+      {
+        Set (LIVE_FINISHED, 1);
+        Store ();
+      }
+  }
+
+  /// Mark the simulation finished and unmap the file, which stays.
+  void Close (void)
+  {
+    if (m_header == 0)
+      {
+        return;
+      }
+    Finish ();
+    munmap (m_header, m_size);
+    close (m_fd);
+    m_header = 0;
+    m_values = 0;
+    m_fd = -1;
+  }
+
+private:
+  /// Copy the words into the mapping, between two increments of the sequence.
+  void Store (void)
+  {
+    if (m_header == 0)
+      {
+        return;
+      }
+    uint64_t sequence = m_header->sequence.load (std::memory_order_relaxed);
+    m_header->sequence.store (sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    for (size_t i = 0; i < m_words.size (); i++)
+      {
+        m_values[i].store (m_words[i], std::memory_order_relaxed);
+      }
+    m_header->sequence.store (sequence + 2, std::memory_order_release);
+  }
+
+  void Set (uint32_t i, uint64_t value)
+  {
+    m_words[i] = value;
+  }
+
+  void SetDouble (uint32_t i, double value)
+  {
+    uint64_t bits;
+    std::memcpy (&bits, &value, sizeof (bits));
+    Set (i, bits);
+  }
+
+  static void Ipv4Drop (LiveMetrics *self, const Ipv4Header &header, Ptr<const Packet> packet,
+                        Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    self->m_drops++;
+  }
+
+  static void MacDrop (LiveMetrics *self, Ptr<const Packet> packet)
+  {
+    self->m_drops++;
+  }
+
+  int m_fd;
+  LiveMetricsHeader *m_header;
+  std::atomic<uint64_t> *m_values;
+  size_t m_size;
+
+  // the counters kept by the simulation, totals unless noted
+  uint64_t m_rxPackets;
+  uint64_t m_rxBytes;
+  uint64_t m_intervalBytes;
+  uint64_t m_drops;
+  uint64_t m_controlPackets;
+  uint64_t m_controlBytes;
+  std::vector<uint64_t> m_flowBytes;
+  std::vector<uint64_t> m_intervalFlowBytes;
+  std::vector<uint64_t> m_words;   ///< of the last Publish ()
+  uint64_t m_lastEvents;
+  std::chrono::steady_clock::time_point m_lastWall;
+};
+
+/**
+ * Reads consistent snapshots of the file of a LiveMetrics, from any
+ * process.
+ */
+class LiveMetricsReader
+{
+public:
+  LiveMetricsReader ()
+    : m_header (0),
+      m_values (0),
+      m_size (0)
+  {
+  }
+
+  ~LiveMetricsReader ()
+  {
+    if (m_header != 0)
+      {
+        munmap (const_cast<LiveMetricsHeader *> (m_header), m_size);
+      }
+  }
+
+  /**
+   * \param error set to the reason of a failure
+   * \return false if fileName is not a live metrics file, or not yet
+   */
+  bool Open (const std::string &fileName, std::string &error)
+  {
+    int fd = open (fileName.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        error = "Cannot open " + fileName + ": " + std::strerror (errno);
+        return false;
+      }
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && size_t (st.st_size) >= sizeof (LiveMetricsHeader))
+      {
+        m_size = st.st_size;
+        mapping = mmap (0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      }
+    close (fd);
+    if (mapping == MAP_FAILED)
+      {
+        error = fileName + " is too short";
+        return false;
+      }
+    m_header = static_cast<const LiveMetricsHeader *> (mapping);
+    m_values = reinterpret_cast<const std::atomic<uint64_t> *> (m_header + 1);
+    if (std::memcmp (m_header->magic, LIVE_METRICS_MAGIC, sizeof (m_header->magic)) != 0)
+      {
+        error = fileName + " is not a live metrics file";
+        return false;
+      }
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (m_header->nMetrics != LIVE_METRICS
+        || m_size < sizeof (LiveMetricsHeader) + (LIVE_METRICS + 2 * size_t (m_header->nFlows)) * sizeof (uint64_t))
+      {
+        error = fileName + " has an unexpected layout";
+        return false;
+      }
+    return true;
+  }
+
+  uint32_t GetNFlows (void) const
+  {
+    return m_header->nFlows;
+  }
+
+  /// \return the process id of the simulation
+  int32_t GetPid (void) const
+  {
+    return m_header->pid;
+  }
+
+  /**
+   * Copy the words of the file, LiveMetric first and then the flows.
+   *
+   * \return false if the writer stayed in the middle of an update, e.g.
+   *         because it died there
+   */
+  bool Read (std::vector<uint64_t> &values) const
+  {
+    values.resize (LIVE_METRICS + 2 * size_t (m_header->nFlows));
+    for (uint32_t attempt = 0; attempt < 1000; attempt++)
+      {
+        uint64_t before = m_header->sequence.load (std::memory_order_acquire);
+        if ((before & 1) == 0)
+          {
+            for (size_t i = 0; i < values.size (); i++)
+              {
+                values[i] = m_values[i].load (std::memory_order_relaxed);
+              }
+            std::atomic_thread_fence (std::memory_order_acquire);
+            if (m_header->sequence.load (std::memory_order_relaxed) == before)
+              {
+                return true;
+              }
+          }
+        std::this_thread::yield ();
+      }
+    return false;
+  }
+
+private:
+  const LiveMetricsHeader *m_header;
+  const std::atomic<uint64_t> *m_values;
+  size_t m_size;
+};
+
+} // namespace ns3
+
+#endif /* MANET_LIVE_METRICS_H */
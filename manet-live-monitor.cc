@@ -0,0 +1,104 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Watches a running my-manet-routing-compare through the file of its
+ * --liveMetrics option: prints its counters as one CSV row every
+ * --interval wall-clock seconds, until the simulation finishes or its
+ * process goes away.  With --flows, the goodput of every flow follows
+ * the counters.
+ *
+ *   ./waf --run "my-manet-routing-compare --liveMetrics=/dev/shm/aodv.live" &
+ *   ./waf --run "manet-live-monitor --input=/dev/shm/aodv.live"
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include "ns3/core-module.h"
+#include "manet-live-metrics.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ManetLiveMonitor");
+
+int
+main (int argc, char *argv[])
+{
+  std::string input;
+  double interval = 1.0;
+  bool flows = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Live metrics file of the scenario (--liveMetrics)", input);
+  cmd.AddValue ("interval", "Wall-clock seconds between two rows", interval);
+  cmd.AddValue ("flows", "Add the goodput of every flow in kb/s", flows);
+  cmd.Parse (argc, argv);
+
+  NS_ABORT_MSG_IF (input.empty (), "--input is required");
+  NS_ABORT_MSG_IF (interval <= 0, "--interval must be positive");
+
+  LiveMetricsReader reader;
+  std::string error;
+  NS_ABORT_MSG_UNLESS (reader.Open (input, error), error);
+
+  std::printf ("%s", GetLiveMetricName (0));
+  for (uint32_t m = 1; m < LIVE_FINISHED; m++)
+    {
+      std::printf (",%s", GetLiveMetricName (m));
+    }
+  for (uint32_t i = 0; flows && i < reader.GetNFlows (); i++)
+    {
+      std::printf (",Flow%u", i);
+    }
+  std::printf ("\n");
+
+  std::vector<uint64_t> values;
+  for (;;)
+    {
+      bool alive = kill (reader.GetPid (), 0) == 0 || errno == EPERM;
+      NS_ABORT_MSG_UNLESS (reader.Read (values), input << " is stuck in an update");
+      for (uint32_t m = 0; m < LIVE_FINISHED; m++)
+        {
+          if (IsLiveMetricDouble (m))
+            {
+              std::printf ("%s%g", m > 0 ? "," : "", LiveMetricsToDouble (values[m]));
+            }
+          else
+            {
+              std::printf ("%s%llu", m > 0 ? "," : "", (unsigned long long) values[m]);
+            }
+        }
+      for (uint32_t i = 0; flows && i < reader.GetNFlows (); i++)
+        {
+          std::printf (",%g", LiveMetricsToDouble (values[LIVE_METRICS + 2 * i + 1]));
+        }
+      std::printf ("\n");
+      std::fflush (stdout);
+
+      if (values[LIVE_FINISHED] != 0)
+        {
+          break;
+        }
+      NS_ABORT_MSG_UNLESS (alive, "The simulation " << reader.GetPid () << " exited without finishing");
+      std::this_thread::sleep_for (std::chrono::duration<double> (interval));
+    }
+  return 0;
+}
@@ -0,0 +1,207 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_LOSS_CACHE_H
+#define MANET_LOSS_CACHE_H
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <unordered_map>
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/propagation-loss-model.h"
+
+namespace ns3 {
+
+/**
+ * Propagation loss model that memoizes the loss of another loss model
+ * chain per pair of nodes, whichever of the two transmits.
+ *
+ * Each mobility model seen by the cache has a position epoch, bumped on
+ * every course change.  An entry stays valid as long as the epochs of
+ * both endpoints are the ones it was computed with and neither endpoint
+ * is moving; a pair with a moving endpoint is always passed through,
+ * since its distance changes continuously.  A pair of
+ * ConstantPositionMobilityModel nodes is therefore computed once per
+ * run, and a pair involving a paused random waypoint node until the
+ * pause ends.
+ *
+ * The wrapped chain must be deterministic and symmetric, and its loss
+ * (in dB) must not depend on the transmit power, which holds for the
+ * usual distance based models such as Friis, log-distance or two-ray
+ * ground.
+ */
+class CachedPropagationLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::CachedPropagationLossModel")
+      .SetParent<PropagationLossModel> ()
+      .SetGroupName ("Propagation")
+      .AddConstructor<CachedPropagationLossModel> ()
+    ;
+    return tid;
+  }
+
+  CachedPropagationLossModel ()
+    : m_hits (0),
+      m_misses (0)
+  {
+  }
+
+  /// The loss model chain whose results are cached.
+  void SetInner (Ptr<PropagationLossModel> inner)
+  {
+    m_inner = inner;
+    m_entries.clear ();
+  }
+
+  uint64_t GetHits (void) const
+  {
+    return m_hits;
+  }
+
+  uint64_t GetMisses (void) const
+  {
+    return m_misses;
+  }
+
+private:
+  struct Endpoint
+  {
+    Ptr<MobilityModel> model;   ///< held until the CourseChange trace is disconnected
+    uint32_t epoch;
+    bool moving;
+  };
+
+  /// epochs of key.first and key.second
+  struct Entry
+  {
+    uint32_t epochA;
+    uint32_t epochB;
+    double lossDb;
+  };
+
+  /// the two endpoints, in pointer order
+  typedef std::pair<const MobilityModel *, const MobilityModel *> Key;
+
+  struct KeyHash
+  {
+    size_t operator() (const Key &key) const
+    {
+      size_t a = reinterpret_cast<size_t> (key.first);
+      size_t b = reinterpret_cast<size_t> (key.second);
+      return a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2));
+    }
+  };
+
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+  {
+    NS_ASSERT_MSG (m_inner != 0, "CachedPropagationLossModel needs SetInner ()");
+    const Endpoint &ea = GetEndpoint (a);
+    const Endpoint &eb = GetEndpoint (b);
+    if (ea.moving || eb.moving)
+      {
+        m_misses++;
+        return m_inner->CalcRxPower (txPowerDbm, a, b);
+      }
+    // the loss is symmetric: both directions share one entry
+    Key key (PeekPointer (a), PeekPointer (b));
+    uint32_t epochA = ea.epoch;
+    uint32_t epochB = eb.epoch;
+    if (std::less<const MobilityModel *> () (key.second, key.first))
+      {
+        std::swap (key.first, key.second);
+        std::swap (epochA, epochB);
+      }
+    Entry &entry = m_entries[key];
+    if (entry.epochA == epochA && entry.epochB == epochB)
+      {
+        m_hits++;
+        return txPowerDbm - entry.lossDb;
+      }
+    m_misses++;
+    double rxPowerDbm = m_inner->CalcRxPower (txPowerDbm, a, b);
+    entry.epochA = epochA;
+    entry.epochB = epochB;
+    entry.lossDb = txPowerDbm - rxPowerDbm;
+    return rxPowerDbm;
+  }
+
+  virtual int64_t DoAssignStreams (int64_t stream)
+  {
+    return m_inner == 0 ? 0 : m_inner->AssignStreams (stream);
+  }
+
+  virtual void DoDispose (void)
+  {
+    m_inner = 0;
+    m_entries.clear ();
+    for (std::unordered_map<const MobilityModel *, Endpoint>::iterator i = m_endpoints.begin ();
+         i != m_endpoints.end (); ++i)
+      {
+        i->second.model->TraceDisconnectWithoutContext ("CourseChange",
+                                                        MakeCallback (&CachedPropagationLossModel::CourseChanged, this));
+      }
+    m_endpoints.clear ();
+    PropagationLossModel::DoDispose ();
+  }
+
+  const Endpoint &GetEndpoint (Ptr<MobilityModel> model) const
+  {
+    std::unordered_map<const MobilityModel *, Endpoint>::iterator found = m_endpoints.find (PeekPointer (model));
+    if (found != m_endpoints.end ())
+      {
+        return found->second;
+      }
+    // epochs start at 1, so that a fresh (zeroed) entry never matches
+    Endpoint &endpoint = m_endpoints[PeekPointer (model)];
+    endpoint.model = model;
+    endpoint.epoch = 1;
+    endpoint.moving = IsMoving (model);
+    model->TraceConnectWithoutContext ("CourseChange",
+                                       MakeCallback (&CachedPropagationLossModel::CourseChanged,
+                                                     const_cast<CachedPropagationLossModel *> (this)));
+    return endpoint;
+  }
+
+  void CourseChanged (Ptr<const MobilityModel> model)
+  {
+    Endpoint &endpoint = m_endpoints[PeekPointer (model)];
+    endpoint.epoch++;
+    endpoint.moving = IsMoving (model);
+  }
+
+  static bool IsMoving (Ptr<const MobilityModel> model)
+  {
+    Vector v = model->GetVelocity ();
+    return v.x != 0 || v.y != 0 || v.z != 0;
+  }
+
+  Ptr<PropagationLossModel> m_inner;
+  mutable std::unordered_map<Key, Entry, KeyHash> m_entries;
+  mutable std::unordered_map<const MobilityModel *, Endpoint> m_endpoints;
+  mutable uint64_t m_hits;
+  mutable uint64_t m_misses;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CachedPropagationLossModel);
+
+} // namespace ns3
+
+#endif /* MANET_LOSS_CACHE_H */
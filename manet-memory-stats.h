@@ -0,0 +1,238 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_MEMORY_STATS_H
+#define MANET_MEMORY_STATS_H
+
+#include <cstdio>
+#include <vector>
+#include <malloc.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/wifi-module.h"
+#include "manet-metrics-writer.h"
+#include "manet-scheduler-decorator.h"
+
+namespace ns3 {
+
+/// \return the wifi MAC queues of the devices of node
+inline std::vector<Ptr<WifiMacQueue> >
+GetWifiMacQueues (Ptr<Node> node)
+{
+  static const char *txops[] = { "Txop", "VO_Txop", "VI_Txop", "BE_Txop", "BK_Txop" };
+  std::vector<Ptr<WifiMacQueue> > queues;
+  for (uint32_t i = 0; i < node->GetNDevices (); i++)
+    {
+      Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice> (node->GetDevice (i));
+      if (device == 0)
+        {
+          continue;
+        }
+      Ptr<WifiMac> mac = device->GetMac ();
+      // the access categories only exist with QoS
+      BooleanValue qos;
+      uint32_t nTxops = mac->GetAttributeFailSafe ("QosSupported", qos) && qos.Get () ? 5 : 1;
+      for (uint32_t j = 0; j < nTxops; j++)
+        {
+          PointerValue txop;
+          if (!mac->GetAttributeFailSafe (txops[j], txop) || txop.Get<Txop> () == 0)
+            {
+              continue;
+            }
+          PointerValue queue;
+          txop.Get<Txop> ()->GetAttribute ("Queue", queue);
+          queues.push_back (queue.Get<WifiMacQueue> ());
+        }
+    }
+  return queues;
+}
+
+/**
+ * SchedulerDecorator that keeps count of the events in the queue,
+ * cancelled ones included until they are removed.  The simulator
+ * offers no way to reach its scheduler, so the count of the one
+ * scheduler in use is read with GetCurrentLength ().
+ */
+class QueueLengthScheduler : public SchedulerDecorator
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::QueueLengthScheduler")
+      .SetParent<SchedulerDecorator> ()
+      .SetGroupName ("Core")
+      .AddConstructor<QueueLengthScheduler> ()
+    ;
+    return tid;
+  }
+
+  QueueLengthScheduler ()
+    : m_length (0)
+  {
+    GetCurrent () = this;
+  }
+
+  ~QueueLengthScheduler ()
+  {
+    if (GetCurrent () == this)
+      {
+        GetCurrent () = 0;
+      }
+  }
+
+  /// \return the number of events queued, 0 without a QueueLengthScheduler
+  static uint64_t GetCurrentLength (void)
+  {
+    return GetCurrent () == 0 ? 0 : GetCurrent ()->m_length;
+  }
+
+  virtual void Insert (const Event &ev)
+  {
+    m_length++;
+    m_inner->Insert (ev);
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    m_length--;
+    return m_inner->RemoveNext ();
+  }
+
+  virtual void Remove (const Event &ev)
+  {
+    m_length--;
+    m_inner->Remove (ev);
+  }
+
+private:
+  static QueueLengthScheduler *&GetCurrent (void)
+  {
+    static QueueLengthScheduler *current = 0;
+    return current;
+  }
+
+  uint64_t m_length;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (QueueLengthScheduler);
+
+/**
+ * Samples the memory use of the simulation, for one row per interval
+ * (SimulationSecond,RssKiB,HeapBytes,PacketsCreated,QueuedPackets,
+ * QueuedBytes,PendingEvents):
+ *
+ * - RssKiB: resident set size of the process;
+ * - HeapBytes: bytes allocated with malloc and not yet freed, which is
+ *   where packet buffers, tags and metadata (with Packet::EnablePrinting)
+ *   live along with every other object;
+ * - PacketsCreated: packets created during the interval, from the packet
+ *   uid counter, which ns-3 only exposes through a new packet: every
+ *   sample takes a uid, so the uids in ASCII and pcap traces differ from
+ *   those of a run without MemoryStats;
+ * - QueuedPackets and QueuedBytes: packets waiting in the wifi MAC queues
+ *   of the installed devices, where undelivered traffic accumulates;
+ * - PendingEvents: events in the scheduler queue, when the simulator
+ *   runs a QueueLengthScheduler.
+ *
+ * ns-3 keeps no count of the live Packet objects, so a leak shows as
+ * HeapBytes growing while QueuedPackets and PendingEvents stay flat.
+ */
+class MemoryStats
+{
+public:
+  MemoryStats ()
+    : m_nextUid (0)
+  {
+  }
+
+  /// Find the MAC queues of the wifi devices of nodes.
+  void Install (NodeContainer nodes)
+  {
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        std::vector<Ptr<WifiMacQueue> > queues = GetWifiMacQueues (*i);
+        m_queues.insert (m_queues.end (), queues.begin (), queues.end ());
+      }
+    m_nextUid = GetLastUid () + 1;
+  }
+
+  /// Write the row of the interval ending now.
+  void Sample (MetricsWriter &writer, double now)
+  {
+    uint64_t uid = GetLastUid ();
+    uint64_t queuedPackets = 0;
+    uint64_t queuedBytes = 0;
+    for (std::vector<Ptr<WifiMacQueue> >::const_iterator i = m_queues.begin (); i != m_queues.end (); ++i)
+      {
+        queuedPackets += (*i)->GetNPackets ();
+        queuedBytes += (*i)->GetNBytes ();
+      }
+    writer.AddDouble (now)
+      .AddUint (GetRssKib ())
+      .AddUint (GetHeapBytes ())
+      .AddUint (uid - m_nextUid)
+      .AddUint (queuedPackets)
+      .AddUint (queuedBytes)
+      .AddUint (QueueLengthScheduler::GetCurrentLength ());
+    writer.EndRow (now);
+    m_nextUid = uid + 1;
+  }
+
+  /// \return the resident set size of the process in KiB
+  static uint64_t GetRssKib (void)
+  {
+    long pages = 0;
+    long resident = 0;
+    std::FILE *statm = std::fopen ("/proc/self/statm", "r");
+    if (statm != 0)
+      {
+        if (std::fscanf (statm, "%ld %ld", &pages, &resident) != 2)
+          {
+            resident = 0;
+          }
+        std::fclose (statm);
+      }
+    return resident * (sysconf (_SC_PAGESIZE) / 1024);
+  }
+
+  /// \return the bytes allocated with malloc and not freed
+  static uint64_t GetHeapBytes (void)
+  {
+#if defined (__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2 ();
+#else
+    // wraps around past 4 GiB
+    struct mallinfo info = mallinfo ();
+#endif
+    return uint64_t (info.uordblks) + uint64_t (info.hblkhd);
+  }
+
+private:
+  /// \return the uid of a packet created for the purpose, the latest one;
+  /// it consumes that uid
+  static uint64_t GetLastUid (void)
+  {
+    return Create<Packet> ()->GetUid ();
+  }
+
+  std::vector<Ptr<WifiMacQueue> > m_queues;
+  uint64_t m_nextUid;   ///< first uid after the previous sample's packet
+};
+
+} // namespace ns3
+
+#endif /* MANET_MEMORY_STATS_H */
@@ -0,0 +1,377 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_METRICS_EXPORTER_H
+#define MANET_METRICS_EXPORTER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "manet-live-metrics.h"
+
+namespace ns3 {
+
+/**
+ * Serves the LiveMetrics counters of the run over HTTP on the loopback
+ * interface, in the Prometheus text exposition format, e.g.
+ *
+ *   manet_rx_bytes_total{protocol="AODV",run="1"} 1843200
+ *   manet_flow_goodput_kbps{protocol="AODV",run="1",flow="3"} 16.384
+ *
+ * The simulator thread hands the words of every LiveMetrics::Publish ()
+ * to Publish (), which copies them into the back one of two snapshots
+ * and makes it the front one; a thread of its own answers the scrapes
+ * from the front snapshot.  Neither thread ever waits for the other: a
+ * scrape marks the snapshot it copies, and a Publish () that finds the
+ * back snapshot still marked by a slow scrape is skipped, the next
+ * interval publishing again.  Every request is answered and the
+ * connection closed, whatever its path.
+ */
+class MetricsExporter
+{
+public:
+  MetricsExporter ()
+    : m_listen (-1),
+      m_front (0)
+  {
+    m_stop[0] = -1;
+    m_stop[1] = -1;
+    m_readers[0] = 0;
+    m_readers[1] = 0;
+  }
+
+  ~MetricsExporter ()
+  {
+    Stop ();
+  }
+
+  /**
+   * Listen on 127.0.0.1 and start serving.
+   *
+   * \param port the TCP port, or 0 for any free one
+   * \param labels the labels of every sample, e.g. protocol="AODV"
+   * \param error set to the reason of a failure
+   * \return false if the port cannot be bound
+   */
+  bool Start (uint16_t port, const std::string &labels, std::string &error)
+  {
+    Stop ();
+    m_labels = labels;
+    m_listen = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    struct sockaddr_in address;
+    std::memset (&address, 0, sizeof (address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons (port);
+    address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    if (m_listen < 0
+        || setsockopt (m_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) != 0
+        || bind (m_listen, reinterpret_cast<struct sockaddr *> (&address), sizeof (address)) != 0
+        || listen (m_listen, 16) != 0
+        || pipe2 (m_stop, O_CLOEXEC) != 0)
+      {
+        error = std::string ("Cannot listen on 127.0.0.1: ") + std::strerror (errno);
+        Stop ();
+        return false;
+      }
+    m_thread = std::thread (&MetricsExporter::Serve, this);
+    return true;
+  }
+
+  /// \return the port listened on, 0 if not started
+  uint16_t GetPort (void) const
+  {
+    struct sockaddr_in address;
+    socklen_t length = sizeof (address);
+    if (m_listen < 0 || getsockname (m_listen, reinterpret_cast<struct sockaddr *> (&address), &length) != 0)
+      {
+        return 0;
+      }
+    return ntohs (address.sin_port);
+  }
+
+  bool IsStarted (void) const
+  {
+    return m_listen >= 0;
+  }
+
+  /**
+   * Make values, LiveMetrics words, the ones served.  Simulator thread
+   * only.
+   *
+   * \return false if skipped because a scrape still holds the back snapshot
+   */
+  bool Publish (const std::vector<uint64_t> &values)
+  {
+    uint32_t back = 1 - m_front.load ();
+    if (m_readers[back].load () != 0)
+      {
+        return false;
+      }
+    m_snapshots[back] = values;
+    m_front.store (back);
+    return true;
+  }
+
+  void Stop (void)
+  {
+    if (m_thread.joinable ())
+      {
+        char c = 0;
+        while (write (m_stop[1], &c, 1) < 0 && errno == EINTR)
+          {
+          }
+        m_thread.join ();
+      }
+    Close (m_listen);
+    Close (m_stop[0]);
+    Close (m_stop[1]);
+  }
+
+private:
+  static void Close (int &fd)
+  {
+    if (fd >= 0)
+      {
+        close (fd);
+        fd = -1;
+      }
+  }
+
+  void Serve (void)
+  {
+    struct pollfd fds[2];
+    fds[0].fd = m_listen;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_stop[0];
+    fds[1].events = POLLIN;
+    for (;;)
+      {
+        if (poll (fds, 2, -1) < 0)
+          {
+            if (errno == EINTR)
+              {
+                continue;
+              }
+            std::perror ("MetricsExporter");
+            return;
+          }
+        if (fds[1].revents != 0)
+          {
+            return;
+          }
+        int connection = accept4 (m_listen, 0, 0, SOCK_CLOEXEC);
+        if (connection >= 0)
+          {
+            Answer (connection);
+            close (connection);
+          }
+      }
+  }
+
+  /// Read the request, up to the end of its header, and send the metrics.
+  void Answer (int connection)
+  {
+    char request[4096];
+    size_t used = 0;
+    request[0] = '\0';
+    struct pollfd fd;
+    fd.fd = connection;
+    fd.events = POLLIN;
+    // a client that sends nothing is dropped after a second
+    while (used < sizeof (request) - 1 && poll (&fd, 1, 1000) > 0)
+      {
+        ssize_t n = read (connection, request + used, sizeof (request) - 1 - used);
+        if (n <= 0)
+          {
+            break;
+          }
+        used += n;
+        request[used] = '\0';
+        if (std::strstr (request, "\r\n\r\n") != 0 || std::strstr (request, "\n\n") != 0)
+          {
+            break;
+          }
+      }
+
+    std::string body = Format ();
+    char header[160];
+    int length = std::snprintf (header, sizeof (header),
+                                "HTTP/1.0 200 OK\r\n"
+                                "Content-Type: text/plain; version=0.0.4\r\n"
+                                "Content-Length: %u\r\n"
+                                "Connection: close\r\n\r\n",
+                                unsigned (body.size ()));
+    std::string response (header, length);
+    if (std::strncmp (request, "HEAD ", 5) != 0)
+      {
+        response += body;
+      }
+    const char *data = response.data ();
+    size_t left = response.size ();
+    while (left > 0)
+      {
+        ssize_t n = send (connection, data, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if (n <= 0)
+          {
+            break;
+          }
+        data += n;
+        left -= n;
+      }
+  }
+
+  /// \return the front snapshot in the Prometheus text format
+  std::string Format (void)
+  {
+    // hold the front snapshot while copying it, see Publish ()
+    uint32_t front;
+    for (;;)
+      {
+        front = m_front.load ();
+        m_readers[front]++;
+        if (m_front.load () == front)
+          {
+            break;
+          }
+        m_readers[front]--;
+      }
+    std::vector<uint64_t> values = m_snapshots[front];
+    m_readers[front]--;
+
+    std::string out;
+    if (values.size () < LIVE_METRICS)
+      {
+        // nothing published yet
+        return out;
+      }
+    for (uint32_t m = 0; m < LIVE_METRICS; m++)
+      {
+        const Family &family = GetFamily (m);
+        AddFamily (out, family);
+        AddSample (out, family.name, "", values[m], IsLiveMetricDouble (m));
+      }
+    uint32_t nFlows = (values.size () - LIVE_METRICS) / 2;
+    static const Family flowFamilies[2] = {
+      { "manet_flow_rx_bytes_total", "counter", "Application bytes received by the flow" },
+      { "manet_flow_goodput_kbps", "gauge", "Goodput of the flow over the last interval in kb/s" }
+    };
+    for (uint32_t j = 0; j < 2; j++)
+      {
+        AddFamily (out, flowFamilies[j]);
+        for (uint32_t i = 0; i < nFlows; i++)
+          {
+            char flow[32];
+            std::snprintf (flow, sizeof (flow), "flow=\"%u\"", i);
+            AddSample (out, flowFamilies[j].name, flow, values[LIVE_METRICS + 2 * i + j], j == 1);
+          }
+      }
+    return out;
+  }
+
+  struct Family
+  {
+    const char *name;
+    const char *type;
+    const char *help;
+  };
+
+  /// \return the metric family of a LiveMetric
+  static const Family &GetFamily (uint32_t metric)
+  {
+    static const Family families[LIVE_METRICS] = {
+      { "manet_simulation_seconds", "gauge", "Simulated time" },
+      { "manet_events_total", "counter", "Simulator events executed" },
+      { "manet_event_rate", "gauge", "Events per wall-clock second over the last interval" },
+      { "manet_rx_packets_total", "counter", "Application packets received" },
+      { "manet_rx_bytes_total", "counter", "Application bytes received" },
+      { "manet_receive_rate_kbps", "gauge", "Application receive rate over the last interval in kb/s" },
+      { "manet_drops_total", "counter", "Packets dropped by IPv4 or the wifi MAC" },
+      { "manet_control_packets_total", "counter", "Routing control packets sent" },
+      { "manet_control_bytes_total", "counter", "Routing control bytes sent" },
+      { "manet_finished", "gauge", "1 once the simulation is over" }
+    };
+    return families[metric];
+  }
+
+  static void AddFamily (std::string &out, const Family &family)
+  {
+    out += "# HELP ";
+    out += family.name;
+    out += ' ';
+    out += family.help;
+    out += "\n# TYPE ";
+    out += family.name;
+    out += ' ';
+    out += family.type;
+    out += '\n';
+  }
+
+  void AddSample (std::string &out, const char *name, const char *label, uint64_t value, bool isDouble) const
+  {
+    char number[32];
+    if (isDouble)
+      {
+        std::snprintf (number, sizeof (number), "%.15g", LiveMetricsToDouble (value));
+      }
+    else
+      {
+        std::snprintf (number, sizeof (number), "%llu", static_cast<unsigned long long> (value));
+      }
+    out += name;
+    if (!m_labels.empty () || *label != '\0')
+      {
+        out += '{';
+        out += m_labels;
+        if (!m_labels.empty () && *label != '\0')
+          {
+            out += ',';
+          }
+        out += label;
+        out += '}';
+      }
+    out += ' ';
+    out += number;
+    out += '\n';
+  }
+
+  int m_listen;
+  int m_stop[2];                  ///< pipe waking the thread up to exit
+  std::thread m_thread;
+  std::string m_labels;
+  std::vector<uint64_t> m_snapshots[2];
+  std::atomic<uint32_t> m_front;  ///< the snapshot served
+  std::atomic<uint32_t> m_readers[2];
+};
+
+} // namespace ns3
+
+#endif /* MANET_METRICS_EXPORTER_H */
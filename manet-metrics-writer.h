@@ -0,0 +1,740 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_METRICS_WRITER_H
+#define MANET_METRICS_WRITER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+/// File formats of MetricsWriter.
+enum MetricsFormat
+{
+  METRICS_CSV,
+  METRICS_GORILLA   ///< compressed time series, see MetricsWriter
+};
+
+/// Value types of a METRICS_GORILLA column.
+enum MetricsColumnType
+{
+  METRICS_DOUBLE,
+  METRICS_UINT,
+  METRICS_INT,
+  METRICS_STRING
+};
+
+static const char METRICS_GORILLA_MAGIC[8] = { 'M', 'T', 'S', 'G', 'O', 'R', '0', '1' };
+
+/**
+ * Bit-level encoding shared by the METRICS_GORILLA writer and reader,
+ * after Pelkonen et al., "Gorilla: A Fast, Scalable, In-Memory Time
+ * Series Database", VLDB 2015.
+ */
+struct GorillaColumn
+{
+  GorillaColumn ()
+    : type (METRICS_DOUBLE),
+      previous (0),
+      leading (0),
+      trailing (0),
+      window (false)
+  {
+  }
+  MetricsColumnType type;
+  uint64_t previous;   ///< bits of the previous value
+  uint32_t leading;    ///< zero bits around the previous meaningful window
+  uint32_t trailing;
+  bool window;         ///< whether there is a previous window
+};
+
+/**
+ * Writer for the per-interval metrics tables, as CSV or as compressed
+ * time series.
+ *
+ * The file is opened once for the whole run.  Rows are encoded straight
+ * into a buffer allocated at Open () time and written out in one go when
+ * the buffer holds more than FlushBytes, when more than FlushInterval
+ * seconds of simulated time have passed since the last write, and on
+ * Close ().
+ *
+ * In CSV, values are formatted like the default std::ostream output the
+ * scenario used to produce.
+ *
+ * METRICS_GORILLA files hold METRICS_GORILLA_MAGIC, the header line as a
+ * uint32_t length and its bytes, then one bit stream of rows, each
+ * starting with a 1 bit; a 0 bit ends the stream.  The first row gives
+ * the number of columns (16 bits) and their MetricsColumnType (2 bits
+ * each), which all rows keep.  The first column must be the time passed
+ * to EndRow (), as a double; it is not stored as a value but as that
+ * time in nanoseconds, in full for the first row and as a delta of
+ * deltas after that ('0' for none, then '10', '110' and '1110' with 7, 9
+ * and 12 bits, or '1111' with 64), and the reader regenerates it from
+ * there.  Every other value is stored as the XOR of its 64 bits
+ * with the previous value of its column: '0' when equal, '10' and the
+ * bits inside the previous window of meaningful bits, or '11', 6 bits of
+ * leading zeros, 6 bits of length - 1 and the meaningful bits.  Strings
+ * are numbered per column in order of appearance and their number is
+ * stored instead, followed the first time by a 16-bit length and the
+ * bytes.  Constant columns thus cost one bit per row, and a steady time
+ * step one bit.  manet-trace-convert renders these files back to CSV.
+ */
+class MetricsWriter
+{
+public:
+  MetricsWriter ()
+    : m_fd (-1),
+      m_used (0),
+      m_flushBytes (64 * 1024),
+      m_flushInterval (10.0),
+      m_lastFlush (0.0),
+      m_firstColumn (true),
+      m_format (METRICS_CSV),
+      m_bits (0),
+      m_nBits (0),
+      m_rows (0),
+      m_previousTime (0),
+      m_previousDelta (0)
+  {
+  }
+
+  ~MetricsWriter ()
+  {
+    Close ();
+  }
+
+  /**
+   * Must be called before Open ().
+   *
+   * \param flushBytes write the buffer out once it holds this many bytes
+   * \param flushInterval write the buffer out once this many simulated
+   *        seconds have passed since the last write; 0 disables the check
+   */
+  void SetFlushPolicy (uint32_t flushBytes, double flushInterval)
+  {
+    m_flushBytes = flushBytes > 0 ? flushBytes : 1;
+    m_flushInterval = flushInterval;
+  }
+
+  /// Must be called before Open ().
+  void SetFormat (MetricsFormat format)
+  {
+    m_format = format;
+  }
+
+  /**
+   * Truncate fileName and write the column header line.
+   *
+   * \return false if the file cannot be created
+   */
+  bool Open (const std::string &fileName, const std::string &header)
+  {
+    Close ();
+    m_fd = open (fileName.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+      {
+        return false;
+      }
+    m_buffer.resize (m_flushBytes + MAX_FIELD);
+    m_used = 0;
+    m_lastFlush = 0.0;
+    m_firstColumn = true;
+    if (m_format == METRICS_GORILLA)
+      {
+        m_columns.clear ();
+        m_dictionaries.clear ();
+        m_row.clear ();
+        m_bits = 0;
+        m_nBits = 0;
+        m_rows = 0;
+        m_previousTime = 0;
+        m_previousDelta = 0;
+        uint32_t length = header.size ();
+        AddRaw (METRICS_GORILLA_MAGIC, sizeof (METRICS_GORILLA_MAGIC));
+        AddRaw (reinterpret_cast<const char *> (&length), sizeof (length));
+        AddRaw (header.c_str (), header.size ());
+        return true;
+      }
+    AddRaw (header.c_str (), header.size ());
+    AddRaw ("\n", 1);
+    return true;
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_fd >= 0;
+  }
+
+  MetricsWriter &AddDouble (double value)
+  {
+    if (m_format == METRICS_GORILLA)
+      {
+        uint64_t bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        return AddValue (METRICS_DOUBLE, bits);
+      }
+    Separator ();
+    m_used += std::snprintf (&m_buffer[m_used], MAX_FIELD, "%g", value);
+    return *this;
+  }
+
+  MetricsWriter &AddUint (uint64_t value)
+  {
+    if (m_format == METRICS_GORILLA)
+      {
+        return AddValue (METRICS_UINT, value);
+      }
+    Separator ();
+    m_used += std::snprintf (&m_buffer[m_used], MAX_FIELD, "%llu", static_cast<unsigned long long> (value));
+    return *this;
+  }
+
+  MetricsWriter &AddInt (int64_t value)
+  {
+    if (m_format == METRICS_GORILLA)
+      {
+        return AddValue (METRICS_INT, value);
+      }
+    Separator ();
+    m_used += std::snprintf (&m_buffer[m_used], MAX_FIELD, "%lld", static_cast<long long> (value));
+    return *this;
+  }
+
+  MetricsWriter &AddString (const std::string &value)
+  {
+    if (m_format == METRICS_GORILLA)
+      {
+        uint32_t column = m_row.size ();
+        if (m_dictionaries.size () <= column)
+          {
+            m_dictionaries.resize (column + 1);
+          }
+        std::map<std::string, uint64_t> &dictionary = m_dictionaries[column];
+        std::map<std::string, uint64_t>::const_iterator i = dictionary.find (value);
+        if (i != dictionary.end ())
+          {
+            return AddValue (METRICS_STRING, i->second);
+          }
+        uint64_t id = dictionary.size ();
+        dictionary[value] = id;
+        AddValue (METRICS_STRING, id);
+        m_row.back ().isNew = true;
+        m_row.back ().text = value.substr (0, 0xffff);
+        return *this;
+      }
+    Separator ();
+    AddRaw (value.c_str (), value.size ());
+    return *this;
+  }
+
+  /**
+   * Terminate the current row.
+   *
+   * \param now the current simulation time in seconds, used for the
+   *        time based flush threshold
+   */
+  void EndRow (double now)
+  {
+    if (m_format == METRICS_GORILLA)
+      {
+        EncodeRow (now);
+      }
+    else
+      {
+        AddRaw ("\n", 1);
+      }
+    m_firstColumn = true;
+    if (m_used >= m_flushBytes
+        || (m_flushInterval > 0 && now - m_lastFlush >= m_flushInterval))
+      {
+        Flush ();
+        m_lastFlush = now;
+      }
+  }
+
+  void Flush (void)
+  {
+    const char *data = &m_buffer[0];
+    while (m_fd >= 0 && m_used > 0)
+      {
+        ssize_t n = write (m_fd, data, m_used);
+        if (n < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if (n <= 0)
+          {
+            // nothing sensible left to do with the data
+            std::perror ("MetricsWriter");
+            break;
+          }
+        data += n;
+        m_used -= n;
+      }
+    m_used = 0;
+  }
+
+  void Close (void)
+  {
+    if (m_fd >= 0)
+      {
+        if (m_format == METRICS_GORILLA)
+          {
+            // end of stream, then the last partial byte
+            PutBits (0, 1);
+            if (m_nBits > 0)
+              {
+                PutBits (0, 8 - m_nBits);
+              }
+          }
+        Flush ();
+        close (m_fd);
+        m_fd = -1;
+      }
+  }
+
+private:
+  /// room reserved past m_flushBytes for a single formatted number
+  static const uint32_t MAX_FIELD = 32;
+
+  void Separator (void)
+  {
+    if (m_used >= m_flushBytes)
+      {
+        Flush ();
+      }
+    if (!m_firstColumn)
+      {
+        m_buffer[m_used++] = ',';
+      }
+    m_firstColumn = false;
+  }
+
+  void AddRaw (const char *data, uint32_t size)
+  {
+    while (size > 0)
+      {
+        if (m_used >= m_flushBytes)
+          {
+            Flush ();
+          }
+        uint32_t chunk = std::min<uint32_t> (size, m_buffer.size () - m_used);
+        std::memcpy (&m_buffer[m_used], data, chunk);
+        m_used += chunk;
+        data += chunk;
+        size -= chunk;
+      }
+  }
+
+  /// A value of the METRICS_GORILLA row being added.
+  struct Value
+  {
+    MetricsColumnType type;
+    uint64_t bits;
+    bool isNew;         ///< a string seen for the first time
+    std::string text;   ///< and its bytes
+  };
+
+  MetricsWriter &AddValue (MetricsColumnType type, uint64_t bits)
+  {
+    Value value;
+    value.type = type;
+    value.bits = bits;
+    value.isNew = false;
+    m_row.push_back (value);
+    return *this;
+  }
+
+  /// Append the n low bits of value, most significant first.
+  void PutBits (uint64_t value, uint32_t n)
+  {
+    while (n > 0)
+      {
+        uint32_t chunk = std::min (n, 8 - m_nBits);
+        n -= chunk;
+        m_bits = (m_bits << chunk) | ((value >> n) & ((1u << chunk) - 1));
+        m_nBits += chunk;
+        if (m_nBits == 8)
+          {
+            if (m_used >= m_buffer.size ())
+              {
+                Flush ();
+              }
+            m_buffer[m_used++] = static_cast<char> (m_bits);
+            m_bits = 0;
+            m_nBits = 0;
+          }
+      }
+  }
+
+  void EncodeRow (double now)
+  {
+    PutBits (1, 1);
+    if (m_rows == 0)
+      {
+        m_columns.resize (m_row.size ());
+        PutBits (m_row.size (), 16);
+        for (uint32_t i = 0; i < m_row.size (); i++)
+          {
+            m_columns[i].type = m_row[i].type;
+            PutBits (m_row[i].type, 2);
+          }
+      }
+    if (m_row.size () != m_columns.size ())
+      {
+        std::fprintf (stderr, "MetricsWriter: row of %u columns instead of %u\n",
+                      unsigned (m_row.size ()), unsigned (m_columns.size ()));
+        std::abort ();
+      }
+    uint64_t nowBits;
+    std::memcpy (&nowBits, &now, sizeof (nowBits));
+    if (m_row.empty () || m_row[0].type != METRICS_DOUBLE || m_row[0].bits != nowBits)
+      {
+        std::fprintf (stderr, "MetricsWriter: the first column is not the time of the row\n");
+        std::abort ();
+      }
+
+    int64_t time = static_cast<int64_t> (now * 1e9 + (now < 0 ? -0.5 : 0.5));
+    if (m_rows == 0)
+      {
+        PutBits (time, 64);
+      }
+    else
+      {
+        int64_t delta = time - m_previousTime;
+        int64_t dod = delta - m_previousDelta;
+        if (dod == 0)
+          {
+            PutBits (0, 1);
+          }
+        else if (dod >= -64 && dod <= 63)
+          {
+            PutBits (2, 2);
+            PutBits (dod, 7);
+          }
+        else if (dod >= -256 && dod <= 255)
+          {
+            PutBits (6, 3);
+            PutBits (dod, 9);
+          }
+        else if (dod >= -2048 && dod <= 2047)
+          {
+            PutBits (14, 4);
+            PutBits (dod, 12);
+          }
+        else
+          {
+            PutBits (15, 4);
+            PutBits (dod, 64);
+          }
+        m_previousDelta = delta;
+      }
+    m_previousTime = time;
+
+    // the first column is the time
+    for (uint32_t i = 1; i < m_row.size (); i++)
+      {
+        GorillaColumn &column = m_columns[i];
+        if (m_row[i].type != column.type)
+          {
+            std::fprintf (stderr, "MetricsWriter: column %u changed type\n", i);
+            std::abort ();
+          }
+        uint64_t x = m_row[i].bits ^ column.previous;
+        column.previous = m_row[i].bits;
+        if (x == 0)
+          {
+            PutBits (0, 1);
+          }
+        else
+          {
+            uint32_t leading = std::min (__builtin_clzll (x), 63);
+            uint32_t trailing = __builtin_ctzll (x);
+            if (column.window && leading >= column.leading && trailing >= column.trailing)
+              {
+                PutBits (2, 2);
+                PutBits (x >> column.trailing, 64 - column.leading - column.trailing);
+              }
+            else
+              {
+                uint32_t length = 64 - leading - trailing;
+                PutBits (3, 2);
+                PutBits (leading, 6);
+                PutBits (length - 1, 6);
+                PutBits (x >> trailing, length);
+                column.leading = leading;
+                column.trailing = trailing;
+                column.window = true;
+              }
+          }
+        if (m_row[i].isNew)
+          {
+            PutBits (m_row[i].text.size (), 16);
+            for (uint32_t j = 0; j < m_row[i].text.size (); j++)
+              {
+                PutBits (static_cast<uint8_t> (m_row[i].text[j]), 8);
+              }
+          }
+      }
+    m_row.clear ();
+    m_rows++;
+  }
+
+  int m_fd;
+  std::vector<char> m_buffer;
+  uint32_t m_used;
+  uint32_t m_flushBytes;
+  double m_flushInterval;
+  double m_lastFlush;
+  bool m_firstColumn;
+
+  MetricsFormat m_format;
+  std::vector<Value> m_row;
+  std::vector<GorillaColumn> m_columns;
+  std::vector<std::map<std::string, uint64_t> > m_dictionaries;   ///< per string column
+  uint64_t m_bits;       ///< bits not yet making a whole byte
+  uint32_t m_nBits;
+  uint64_t m_rows;
+  int64_t m_previousTime;
+  int64_t m_previousDelta;
+};
+
+/**
+ * Decoder of the METRICS_GORILLA files of MetricsWriter, one row at a
+ * time.
+ */
+class MetricsReader
+{
+public:
+  /// \param in the file, positioned past METRICS_GORILLA_MAGIC
+  explicit MetricsReader (std::FILE *in)
+    : m_in (in),
+      m_bits (0),
+      m_nBits (0),
+      m_corrupt (false),
+      m_rows (0),
+      m_time (0),
+      m_previousDelta (0)
+  {
+  }
+
+  /// \return false if the file is too short
+  bool ReadHeader (std::string &header)
+  {
+    uint32_t length;
+    if (std::fread (&length, sizeof (length), 1, m_in) != 1)
+      {
+        return false;
+      }
+    header.resize (length);
+    return length == 0 || std::fread (&header[0], 1, length, m_in) == length;
+  }
+
+  /// \return false at the end of the rows, or if the file is corrupt
+  bool ReadRow (void)
+  {
+    if (GetBits (1) == 0 || m_corrupt)
+      {
+        return false;
+      }
+    if (m_rows == 0)
+      {
+        m_columns.resize (GetBits (16));
+        m_dictionaries.resize (m_columns.size ());
+        for (uint32_t i = 0; i < m_columns.size (); i++)
+          {
+            m_columns[i].type = static_cast<MetricsColumnType> (GetBits (2));
+          }
+        if (m_columns.empty () || m_columns[0].type != METRICS_DOUBLE)
+          {
+            m_corrupt = true;
+            return false;
+          }
+        m_time = GetBits (64);
+      }
+    else
+      {
+        int64_t dod;
+        if (GetBits (1) == 0)
+          {
+            dod = 0;
+          }
+        else if (GetBits (1) == 0)
+          {
+            dod = GetSigned (7);
+          }
+        else if (GetBits (1) == 0)
+          {
+            dod = GetSigned (9);
+          }
+        else if (GetBits (1) == 0)
+          {
+            dod = GetSigned (12);
+          }
+        else
+          {
+            dod = GetBits (64);
+          }
+        m_previousDelta += dod;
+        m_time += m_previousDelta;
+      }
+
+    // the first column is the time
+    double seconds = GetTime ();
+    std::memcpy (&m_columns[0].previous, &seconds, sizeof (seconds));
+    for (uint32_t i = 1; i < m_columns.size (); i++)
+      {
+        GorillaColumn &column = m_columns[i];
+        if (GetBits (1) == 1)
+          {
+            if (GetBits (1) == 1)
+              {
+                column.leading = GetBits (6);
+                uint32_t length = GetBits (6) + 1;
+                if (column.leading + length > 64)
+                  {
+                    m_corrupt = true;
+                    return false;
+                  }
+                column.trailing = 64 - column.leading - length;
+                column.window = true;
+              }
+            else if (!column.window)
+              {
+                m_corrupt = true;
+                return false;
+              }
+            column.previous ^= GetBits (64 - column.leading - column.trailing) << column.trailing;
+          }
+        if (column.type == METRICS_STRING && column.previous == m_dictionaries[i].size ())
+          {
+            // a new string
+            std::string text (GetBits (16), '\0');
+            for (uint32_t j = 0; j < text.size (); j++)
+              {
+                text[j] = static_cast<char> (GetBits (8));
+              }
+            m_dictionaries[i].push_back (text);
+          }
+        else if (column.type == METRICS_STRING && column.previous > m_dictionaries[i].size ())
+          {
+            m_corrupt = true;
+          }
+      }
+    m_rows++;
+    return !m_corrupt;
+  }
+
+  /// \return whether ReadRow () stopped on a malformed or truncated file
+  bool IsCorrupt (void) const
+  {
+    return m_corrupt;
+  }
+
+  /// \return the time of the current row in seconds
+  double GetTime (void) const
+  {
+    return m_time / 1e9;
+  }
+
+  uint32_t GetNColumns (void) const
+  {
+    return m_columns.size ();
+  }
+
+  /// Append column i of the current row, formatted as MetricsWriter does in CSV.
+  void FormatColumn (uint32_t i, std::string &out) const
+  {
+    char field[32];
+    uint64_t bits = m_columns[i].previous;
+    switch (m_columns[i].type)
+      {
+      case METRICS_DOUBLE:
+        {
+          double value;
+          std::memcpy (&value, &bits, sizeof (value));
+          std::snprintf (field, sizeof (field), "%g", value);
+          break;
+        }
+      case METRICS_UINT:
+        std::snprintf (field, sizeof (field), "%llu", static_cast<unsigned long long> (bits));
+        break;
+      case METRICS_INT:
+        std::snprintf (field, sizeof (field), "%lld", static_cast<long long> (bits));
+        break;
+      default:
+        out += m_dictionaries[i][bits];
+        return;
+      }
+    out += field;
+  }
+
+private:
+  /// \return the next n bits, most significant first
+  uint64_t GetBits (uint32_t n)
+  {
+    uint64_t value = 0;
+    while (n > 0)
+      {
+        if (m_nBits == 0)
+          {
+            int c = std::getc (m_in);
+            if (c == EOF)
+              {
+                m_corrupt = true;
+                return 0;
+              }
+            m_bits = c;
+            m_nBits = 8;
+          }
+        uint32_t chunk = std::min (n, m_nBits);
+        m_nBits -= chunk;
+        n -= chunk;
+        value = (value << chunk) | ((m_bits >> m_nBits) & ((1u << chunk) - 1));
+      }
+    return value;
+  }
+
+  int64_t GetSigned (uint32_t n)
+  {
+    uint64_t value = GetBits (n);
+    return value >= (uint64_t (1) << (n - 1)) ? int64_t (value) - (int64_t (1) << n) : int64_t (value);
+  }
+
+  std::FILE *m_in;
+  uint32_t m_bits;
+  uint32_t m_nBits;
+  bool m_corrupt;
+  uint64_t m_rows;
+  int64_t m_time;
+  int64_t m_previousDelta;
+  std::vector<GorillaColumn> m_columns;
+  std::vector<std::vector<std::string> > m_dictionaries;
+};
+
+} // namespace ns3
+
+#endif /* MANET_METRICS_WRITER_H */
@@ -0,0 +1,176 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Generates the waypoint schedule of my-manet-routing-compare once, for
+ * replay with its --mobilityReplay option.
+ *
+ * The nodes are set up exactly as in the scenario: nWifis mobile nodes
+ * with RandomWaypointMobilityModel followed by nWifis static nodes, with
+ * the same position allocator and stream assignment.  Only the mobility
+ * models are simulated, and every course change is recorded as one
+ * segment of the schedule (see manet-mobility-replay.h).
+ *
+ *   ./waf --run "manet-mobility-gen --nWifis=15 --nodeSpeed=20 --output=rwp-15.mob.bin"
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "manet-mobility-replay.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ManetMobilityGen");
+
+static std::vector<std::vector<MobilitySegment> > g_schedules;
+
+static void
+Record (uint32_t node, Ptr<const MobilityModel> model)
+{
+  MobilitySegment segment;
+  segment.start = Simulator::Now ().GetSeconds ();
+  Vector position = model->GetPosition ();
+  Vector velocity = model->GetVelocity ();
+  segment.x = position.x;
+  segment.y = position.y;
+  segment.z = position.z;
+  segment.vx = velocity.x;
+  segment.vy = velocity.y;
+  segment.vz = velocity.z;
+
+  std::vector<MobilitySegment> &schedule = g_schedules[node];
+  if (!schedule.empty () && schedule.back ().start == segment.start)
+    {
+      // several course changes at the same instant, keep the last one
+      schedule.back () = segment;
+    }
+  else
+    {
+      schedule.push_back (segment);
+    }
+}
+
+static void
+CourseChange (uint32_t node, Ptr<const MobilityModel> model)
+{
+  Record (node, model);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int nWifis = 15;
+  int nodeSpeed = 20;
+  int nodePause = 0;
+  double totalTime = 300.0;
+  std::string output ("mobility.bin");
+
+  CommandLine cmd;
+  cmd.AddValue ("nWifis", "Number of mobile nodes (as many static nodes are added)", nWifis);
+  cmd.AddValue ("nodeSpeed", "Maximum node speed in m/s", nodeSpeed);
+  cmd.AddValue ("nodePause", "Node pause time in s", nodePause);
+  cmd.AddValue ("totalTime", "Simulation time in s", totalTime);
+  cmd.AddValue ("output", "Schedule file", output);
+  cmd.Parse (argc, argv);
+
+  NodeContainer adhocNodes;
+  NodeContainer staticNodes;
+  adhocNodes.Create (nWifis);
+  staticNodes.Create (nWifis);
+  NodeContainer all_Nodes = NodeContainer (adhocNodes, staticNodes);
+
+  // keep in sync with RoutingExperiment::Run
+  MobilityHelper mobilityAdhoc;
+  MobilityHelper mobilityStatic;
+
+  int64_t streamIndex = 0;
+
+  ObjectFactory pos;
+  pos.SetTypeId ("ns3::RandomRectanglePositionAllocator");
+  pos.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
+  pos.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
+
+  Ptr<PositionAllocator> taPositionAlloc = pos.Create ()->GetObject<PositionAllocator> ();
+  streamIndex += taPositionAlloc->AssignStreams (streamIndex);
+
+  std::stringstream ssSpeed;
+  ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << nodeSpeed << "]";
+  std::stringstream ssPause;
+  ssPause << "ns3::ConstantRandomVariable[Constant=" << nodePause << "]";
+
+  mobilityAdhoc.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
+                                  "Speed", StringValue (ssSpeed.str ()),
+                                  "Pause", StringValue (ssPause.str ()),
+                                  "PositionAllocator", PointerValue (taPositionAlloc));
+  mobilityAdhoc.SetPositionAllocator (taPositionAlloc);
+  mobilityAdhoc.Install (adhocNodes);
+
+  streamIndex += mobilityAdhoc.AssignStreams (adhocNodes, streamIndex);
+  NS_UNUSED (streamIndex);
+
+  mobilityStatic.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobilityStatic.SetPositionAllocator (taPositionAlloc);
+  mobilityStatic.Install (staticNodes);
+
+  g_schedules.resize (all_Nodes.GetN ());
+  for (uint32_t i = 0; i < all_Nodes.GetN (); i++)
+    {
+      Ptr<MobilityModel> model = all_Nodes.Get (i)->GetObject<MobilityModel> ();
+      Record (i, model);
+      model->TraceConnectWithoutContext ("CourseChange", MakeBoundCallback (&CourseChange, i));
+    }
+
+  Simulator::Stop (Seconds (totalTime));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  MobilityReplayHeader header;
+  std::memcpy (header.magic, MOBILITY_REPLAY_MAGIC, sizeof (header.magic));
+  header.nNodes = g_schedules.size ();
+  header.reserved = 0;
+  header.totalTime = totalTime;
+
+  std::vector<uint32_t> index;
+  uint32_t nSegments = 0;
+  for (uint32_t i = 0; i < g_schedules.size (); i++)
+    {
+      index.push_back (nSegments);
+      nSegments += g_schedules[i].size ();
+    }
+  index.push_back (nSegments);
+
+  std::FILE *out = std::fopen (output.c_str (), "wb");
+  NS_ABORT_MSG_IF (out == 0, "Cannot create " << output);
+  std::fwrite (&header, sizeof (header), 1, out);
+  std::fwrite (&index[0], sizeof (uint32_t), index.size (), out);
+  static const char padding[8] = { 0 };
+  std::fwrite (padding, 1, MobilityReplaySegmentOffset (header.nNodes)
+               - sizeof (header) - index.size () * sizeof (uint32_t), out);
+  for (uint32_t i = 0; i < g_schedules.size (); i++)
+    {
+      std::fwrite (&g_schedules[i][0], sizeof (MobilitySegment), g_schedules[i].size (), out);
+    }
+  std::fclose (out);
+
+  std::cout << "Wrote " << nSegments << " segments for " << header.nNodes << " nodes to " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,318 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_MOBILITY_REPLAY_H
+#define MANET_MOBILITY_REPLAY_H
+
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+
+namespace ns3 {
+
+/**
+ * Binary waypoint schedule, as written by manet-mobility-gen.
+ *
+ * Layout, in host byte order:
+ * - MobilityReplayHeader
+ * - nNodes + 1 uint32_t, the index of each node's first segment (the
+ *   last entry is the total number of segments)
+ * - zero padding up to MobilityReplaySegmentOffset (nNodes)
+ * - the MobilitySegment array, sorted by node and then by start time
+ *
+ * A node moves with the velocity of a segment from its start time until
+ * the start of the next one, so each course change of the original
+ * mobility model is one segment.
+ */
+struct MobilityReplayHeader
+{
+  char magic[8];
+  uint32_t nNodes;
+  uint32_t reserved;
+  double totalTime;
+};
+
+struct MobilitySegment
+{
+  double start;
+  double x, y, z;
+  double vx, vy, vz;
+};
+
+static const char MOBILITY_REPLAY_MAGIC[8] = { 'M', 'M', 'O', 'B', 'R', 'P', '0', '1' };
+
+/// \return the file offset of the segment array, 8-byte aligned
+inline size_t
+MobilityReplaySegmentOffset (uint32_t nNodes)
+{
+  size_t offset = sizeof (MobilityReplayHeader) + (size_t (nNodes) + 1) * sizeof (uint32_t);
+  return (offset + 7) & ~size_t (7);
+}
+
+/**
+ * A waypoint schedule file, mapped read-only into memory.  Every
+ * ReplayMobilityModel reading from it keeps a reference, so that the
+ * mapping lives as long as the models.
+ */
+class MobilityReplayFile : public SimpleRefCount<MobilityReplayFile>
+{
+public:
+  MobilityReplayFile ()
+    : m_base (0),
+      m_size (0),
+      m_header (0),
+      m_index (0),
+      m_segments (0)
+  {
+  }
+
+  ~MobilityReplayFile ()
+  {
+    if (m_base != 0)
+      {
+        munmap (m_base, m_size);
+      }
+  }
+
+  /// \return false if the file cannot be mapped or is not a schedule
+  bool Open (std::string fileName)
+  {
+    int fd = open (fileName.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return false;
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (MobilityReplayHeader))
+      {
+        close (fd);
+        return false;
+      }
+    m_size = st.st_size;
+    void *base = mmap (0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (base == MAP_FAILED)
+      {
+        return false;
+      }
+    m_base = base;
+    m_header = static_cast<const MobilityReplayHeader *> (base);
+    m_index = reinterpret_cast<const uint32_t *> (m_header + 1);
+    size_t offset = MobilityReplaySegmentOffset (m_header->nNodes);
+    if (std::memcmp (m_header->magic, MOBILITY_REPLAY_MAGIC, sizeof (MOBILITY_REPLAY_MAGIC)) != 0
+        || offset > m_size)
+      {
+        return false;
+      }
+    m_segments = reinterpret_cast<const MobilitySegment *> (static_cast<const char *> (base) + offset);
+    // Begin () and End () trust the index: it must not go backwards nor
+    // past the segments that the file holds
+    uint32_t nNodes = m_header->nNodes;
+    if (m_index[nNodes] > (m_size - offset) / sizeof (MobilitySegment))
+      {
+        return false;
+      }
+    for (uint32_t i = 0; i < nNodes; i++)
+      {
+        if (m_index[i] > m_index[i + 1])
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  uint32_t GetNNodes (void) const
+  {
+    return m_header->nNodes;
+  }
+
+  double GetTotalTime (void) const
+  {
+    return m_header->totalTime;
+  }
+
+  const MobilitySegment *Begin (uint32_t node) const
+  {
+    return m_segments + m_index[node];
+  }
+
+  const MobilitySegment *End (uint32_t node) const
+  {
+    return m_segments + m_index[node + 1];
+  }
+
+  /**
+   * Install a ReplayMobilityModel on each node; the i-th node of the
+   * container replays the i-th schedule of the file.
+   */
+  void Install (NodeContainer nodes);
+
+private:
+  void *m_base;
+  size_t m_size;
+  const MobilityReplayHeader *m_header;
+  const uint32_t *m_index;
+  const MobilitySegment *m_segments;
+};
+
+/**
+ * Mobility model that replays one node's schedule from a
+ * MobilityReplayFile.
+ *
+ * Positions are computed from the current segment on demand; the only
+ * events are the course change notifications at segment boundaries.
+ */
+class ReplayMobilityModel : public MobilityModel
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::ReplayMobilityModel")
+      .SetParent<MobilityModel> ()
+      .SetGroupName ("Mobility")
+      .AddConstructor<ReplayMobilityModel> ()
+    ;
+    return tid;
+  }
+
+  ReplayMobilityModel ()
+    : m_current (0),
+      m_end (0),
+      m_fixed (false)
+  {
+  }
+
+  void SetSchedule (Ptr<const MobilityReplayFile> file, uint32_t node)
+  {
+    NS_ASSERT (node < file->GetNNodes ());
+    NS_ASSERT (file->Begin (node) != file->End (node));
+    m_file = file;
+    m_current = file->Begin (node);
+    m_end = file->End (node);
+  }
+
+private:
+  virtual void DoInitialize (void)
+  {
+    Seek ();
+    ScheduleNextCourseChange ();
+    MobilityModel::DoInitialize ();
+  }
+
+  virtual void DoDispose (void)
+  {
+    m_event.Cancel ();
+    m_file = 0;
+    MobilityModel::DoDispose ();
+  }
+
+  virtual Vector DoGetPosition (void) const
+  {
+    if (m_fixed)
+      {
+        return m_position;
+      }
+    Seek ();
+    double dt = Simulator::Now ().GetSeconds () - m_current->start;
+    if (dt < 0)
+      {
+        dt = 0;
+      }
+    return Vector (m_current->x + m_current->vx * dt,
+                   m_current->y + m_current->vy * dt,
+                   m_current->z + m_current->vz * dt);
+  }
+
+  virtual void DoSetPosition (const Vector &position)
+  {
+    // an explicit position ends the replay
+    m_event.Cancel ();
+    m_fixed = true;
+    m_position = position;
+    NotifyCourseChange ();
+  }
+
+  virtual Vector DoGetVelocity (void) const
+  {
+    if (m_fixed)
+      {
+        return Vector (0, 0, 0);
+      }
+    Seek ();
+    return Vector (m_current->vx, m_current->vy, m_current->vz);
+  }
+
+  /// Move m_current forward to the segment that covers the current time.
+  void Seek (void) const
+  {
+    // compare as Time, so that a boundary rounded to the same time step
+    // as the course change event that handles it is always consumed
+    Time now = Simulator::Now ();
+    while (m_current + 1 != m_end && Seconds ((m_current + 1)->start) <= now)
+      {
+        m_current++;
+      }
+  }
+
+  void ScheduleNextCourseChange (void)
+  {
+    if (m_current + 1 != m_end)
+      {
+        Time next = Seconds ((m_current + 1)->start) - Simulator::Now ();
+        m_event = Simulator::Schedule (next, &ReplayMobilityModel::CourseChange, this);
+      }
+  }
+
+  void CourseChange (void)
+  {
+    Seek ();
+    NotifyCourseChange ();
+    ScheduleNextCourseChange ();
+  }
+
+  Ptr<const MobilityReplayFile> m_file;
+  mutable const MobilitySegment *m_current;
+  const MobilitySegment *m_end;
+  bool m_fixed;
+  Vector m_position;
+  EventId m_event;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (ReplayMobilityModel);
+
+inline void
+MobilityReplayFile::Install (NodeContainer nodes)
+{
+  NS_ABORT_MSG_IF (nodes.GetN () > GetNNodes (), "Mobility schedule only has " << GetNNodes ()
+                                                 << " nodes, " << nodes.GetN () << " requested");
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      Ptr<ReplayMobilityModel> model = CreateObject<ReplayMobilityModel> ();
+      model->SetSchedule (this, i);
+      nodes.Get (i)->AggregateObject (model);
+    }
+}
+
+} // namespace ns3
+
+#endif /* MANET_MOBILITY_REPLAY_H */
@@ -0,0 +1,255 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_NODE_METRICS_H
+#define MANET_NODE_METRICS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "manet-memory-stats.h"
+#include "manet-routing-overhead.h"
+
+namespace ns3 {
+
+/// The metrics of a node metrics file, in file order.
+enum NodeMetric
+{
+  NODE_RX_BYTES,        ///< IPv4 bytes received, forwarded ones included
+  NODE_TX_BYTES,        ///< IPv4 bytes sent, forwarded ones included
+  NODE_DROPS,           ///< packets dropped by IPv4 or the wifi MAC
+  NODE_CONTROL_BYTES,   ///< routing control bytes sent (see RoutingOverhead)
+  NODE_QUEUE_DEPTH,     ///< packets in the wifi MAC queues at the interval end
+  NODE_METRICS
+};
+
+inline const char *
+GetNodeMetricName (uint32_t metric)
+{
+  static const char *names[NODE_METRICS] = {
+    "RxBytes", "TxBytes", "Drops", "ControlBytes", "QueueDepth"
+  };
+  return names[metric];
+}
+
+/**
+ * Node metrics file, as written by NodeMetrics::Write (), in host byte
+ * order: a NodeMetricsHeader, then one column per metric, each
+ * nNodes x nIntervals uint64_t values, node-major, so that the time
+ * series of one metric of one node is contiguous.
+ */
+struct NodeMetricsHeader
+{
+  char magic[8];
+  uint32_t nNodes;
+  uint32_t nIntervals;
+  uint32_t nMetrics;
+  uint32_t reserved;
+  double interval;      ///< seconds; interval i ends at (i + 1) * interval
+};
+
+static const char NODE_METRICS_MAGIC[8] = { 'M', 'N', 'O', 'D', 'E', 'M', '0', '1' };
+
+/**
+ * Per-node time series of the NodeMetric values, in one array allocated
+ * up front for the whole run and written out once at the end (see
+ * manet-trace-convert for a CSV rendering).
+ *
+ * Add () is all the per-event work: an index computation and an
+ * addition.  Nothing is formatted or written while the simulation runs.
+ * Events past the last interval are charged to it.
+ */
+class NodeMetrics
+{
+public:
+  NodeMetrics ()
+    : m_nNodes (0),
+      m_nIntervals (0),
+      m_interval (1.0)
+  {
+  }
+
+  /**
+   * \param nNodes node ids run from 0 to nNodes - 1
+   * \param totalTime the simulated seconds to cover
+   * \param interval the length of an interval in seconds
+   */
+  void Allocate (uint32_t nNodes, double totalTime, double interval)
+  {
+    m_nNodes = nNodes;
+    m_interval = interval;
+    m_nIntervals = std::max (1.0, std::ceil (totalTime / interval));
+    m_data.assign (size_t (NODE_METRICS) * m_nNodes * m_nIntervals, 0);
+  }
+
+  bool IsAllocated (void) const
+  {
+    return !m_data.empty ();
+  }
+
+  /// \return the interval simulated second now falls in
+  uint32_t GetInterval (double now) const
+  {
+    return std::min<double> (now / m_interval, m_nIntervals - 1);
+  }
+
+  void Add (NodeMetric metric, uint32_t node, uint32_t interval, uint64_t value)
+  {
+    m_data[(size_t (metric) * m_nNodes + node) * m_nIntervals + interval] += value;
+  }
+
+  bool Write (const std::string &fileName) const
+  {
+    std::FILE *out = std::fopen (fileName.c_str (), "wb");
+    if (out == 0)
+      {
+        return false;
+      }
+    NodeMetricsHeader header;
+    std::memcpy (header.magic, NODE_METRICS_MAGIC, sizeof (header.magic));
+    header.nNodes = m_nNodes;
+    header.nIntervals = m_nIntervals;
+    header.nMetrics = NODE_METRICS;
+    header.reserved = 0;
+    header.interval = m_interval;
+    bool ok = std::fwrite (&header, sizeof (header), 1, out) == 1
+      && std::fwrite (m_data.data (), sizeof (uint64_t), m_data.size (), out) == m_data.size ();
+    return std::fclose (out) == 0 && ok;
+  }
+
+private:
+  uint32_t m_nNodes;
+  uint32_t m_nIntervals;
+  double m_interval;
+  std::vector<uint64_t> m_data;
+};
+
+/**
+ * Fills NodeMetrics from the IPv4 and wifi MAC traces of the nodes, and
+ * from the routing overhead counters and MAC queues at the end of every
+ * interval.
+ */
+class NodeMetricsTracer
+{
+public:
+  NodeMetricsTracer ()
+    : m_interval (1.0)
+  {
+  }
+
+  /**
+   * \param nodes the nodes to trace, whose ids must be dense from 0
+   * \param totalTime the simulated seconds to cover
+   * \param interval the length of an interval in seconds
+   */
+  void Install (NodeContainer nodes, double totalTime, double interval)
+  {
+    uint32_t nNodes = 0;
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        nNodes = std::max (nNodes, (*i)->GetId () + 1);
+      }
+    m_metrics.Allocate (nNodes, totalTime, interval);
+    m_interval = interval;
+    m_queues.assign (nNodes, std::vector<Ptr<WifiMacQueue> > ());
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        uint32_t id = (*i)->GetId ();
+        Ptr<Ipv4L3Protocol> ipv4 = (*i)->GetObject<Ipv4L3Protocol> ();
+        NS_ABORT_MSG_IF (ipv4 == 0, "NodeMetricsTracer needs the internet stack installed");
+        ipv4->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&NodeMetricsTracer::Ipv4Rx, this, id));
+        ipv4->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&NodeMetricsTracer::Ipv4Tx, this, id));
+        ipv4->TraceConnectWithoutContext ("Drop", MakeBoundCallback (&NodeMetricsTracer::Ipv4Drop, this, id));
+        for (uint32_t j = 0; j < (*i)->GetNDevices (); j++)
+          {
+            Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice> ((*i)->GetDevice (j));
+            if (device != 0)
+              {
+                device->GetMac ()->TraceConnectWithoutContext ("MacTxDrop",
+                                                               MakeBoundCallback (&NodeMetricsTracer::MacDrop, this, id));
+              }
+          }
+        m_queues[id] = GetWifiMacQueues (*i);
+      }
+  }
+
+  const NodeMetrics &GetMetrics (void) const
+  {
+    return m_metrics;
+  }
+
+  /// Record the control bytes and queue depths of the interval ending now.
+  void EndInterval (double now, const RoutingOverhead &overhead)
+  {
+    if (now < m_interval)
+      {
+        return;
+      }
+    // the middle of the interval, safe from rounding
+    uint32_t interval = m_metrics.GetInterval (now - m_interval / 2);
+    for (uint32_t node = 0; node < m_queues.size (); node++)
+      {
+        m_metrics.Add (NODE_CONTROL_BYTES, node, interval, overhead.GetNodeBytes (node));
+        for (std::vector<Ptr<WifiMacQueue> >::const_iterator i = m_queues[node].begin (); i != m_queues[node].end (); ++i)
+          {
+            m_metrics.Add (NODE_QUEUE_DEPTH, node, interval, (*i)->GetNPackets ());
+          }
+      }
+  }
+
+private:
+  void Add (NodeMetric metric, uint32_t node, uint64_t value)
+  {
+    m_metrics.Add (metric, node, m_metrics.GetInterval (Simulator::Now ().GetSeconds ()), value);
+  }
+
+  static void Ipv4Rx (NodeMetricsTracer *self, uint32_t node, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    self->Add (NODE_RX_BYTES, node, packet->GetSize ());
+  }
+
+  static void Ipv4Tx (NodeMetricsTracer *self, uint32_t node, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    self->Add (NODE_TX_BYTES, node, packet->GetSize ());
+  }
+
+  static void Ipv4Drop (NodeMetricsTracer *self, uint32_t node, const Ipv4Header &header, Ptr<const Packet> packet,
+                        Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    self->Add (NODE_DROPS, node, 1);
+  }
+
+  static void MacDrop (NodeMetricsTracer *self, uint32_t node, Ptr<const Packet> packet)
+  {
+    self->Add (NODE_DROPS, node, 1);
+  }
+
+  NodeMetrics m_metrics;
+  double m_interval;
+  std::vector<std::vector<Ptr<WifiMacQueue> > > m_queues;   ///< per node id
+};
+
+} // namespace ns3
+
+#endif /* MANET_NODE_METRICS_H */
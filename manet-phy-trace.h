@@ -0,0 +1,312 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_PHY_TRACE_H
+#define MANET_PHY_TRACE_H
+
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/wifi-module.h"
+
+namespace ns3 {
+
+/**
+ * Binary form of the PHY events written by WifiPhyHelper::EnableAsciiAll.
+ *
+ * The file starts with PHY_TRACE_MAGIC and is followed by fixed-size
+ * PhyTraceRecord entries in host byte order.  WifiMode names and MAC
+ * frame type names are not repeated in every record: the first time one
+ * is used, a PHY_TRACE_DEFINE_MODE or PHY_TRACE_DEFINE_MAC_TYPE record
+ * binds its name to the small index that the frame records carry.
+ */
+enum PhyTraceEvent
+{
+  PHY_TRACE_TX = 't',
+  PHY_TRACE_RX_OK = 'r',
+  PHY_TRACE_DEFINE_MODE = 'M',
+  PHY_TRACE_DEFINE_MAC_TYPE = 'T'
+};
+
+/// PhyTraceRecord flags
+enum
+{
+  PHY_TRACE_HAS_MAC = 1, ///< the frame fields hold a decoded WifiMacHeader
+  PHY_TRACE_RETRY = 2
+};
+
+struct PhyTraceFrame
+{
+  uint64_t uid;       ///< Packet::GetUid
+  uint16_t duration;  ///< Duration/ID field in microseconds
+  uint16_t sequence;  ///< sequence number, data and management frames only
+  uint8_t addr1[6];
+  uint8_t addr2[6];
+};
+
+struct PhyTraceRecord
+{
+  int64_t timeNs;
+  uint32_t node;
+  uint32_t device;
+  uint8_t event;      ///< a PhyTraceEvent
+  uint8_t mode;       ///< WifiMode index
+  uint8_t macType;    ///< MAC frame type index
+  uint8_t flags;
+  uint32_t size;      ///< packet size in bytes
+  union
+  {
+    PhyTraceFrame frame;
+    char name[24];    ///< null-terminated name, for definition records
+  } u;
+};
+
+static const char PHY_TRACE_MAGIC[8] = { 'M', 'P', 'H', 'Y', 'T', 'R', '0', '1' };
+
+/**
+ * Renders PHY trace records as the lines of the ns-3 ASCII trace.
+ *
+ * Only the MAC header summary stored in the record is available, so the
+ * packet part of each line is the WifiMacHeader followed by the payload
+ * size, not the full list of headers that Packet::Print would produce.
+ */
+class PhyTraceFormatter
+{
+public:
+  PhyTraceFormatter ()
+  {
+    std::memset (m_modes, 0, sizeof (m_modes));
+    std::memset (m_macTypes, 0, sizeof (m_macTypes));
+  }
+
+  /**
+   * \return the number of characters written to buf, 0 for definition
+   *         records, which only update the name tables
+   */
+  int Format (const PhyTraceRecord &r, char *buf, size_t size)
+  {
+    switch (r.event)
+      {
+      case PHY_TRACE_DEFINE_MODE:
+        std::memcpy (m_modes[r.mode], r.u.name, sizeof (r.u.name));
+        m_modes[r.mode][sizeof (r.u.name) - 1] = 0;
+        return 0;
+      case PHY_TRACE_DEFINE_MAC_TYPE:
+        std::memcpy (m_macTypes[r.macType], r.u.name, sizeof (r.u.name));
+        m_macTypes[r.macType][sizeof (r.u.name) - 1] = 0;
+        return 0;
+      case PHY_TRACE_TX:
+        {
+          int n = std::snprintf (buf, size, "t %g /NodeList/%u/DeviceList/%u/$ns3::WifiNetDevice/Phy/State/Tx %s ",
+                                 r.timeNs / 1e9, r.node, r.device, m_modes[r.mode]);
+          return n < 0 || size_t (n) >= size ? n : n + FormatPacket (r, buf + n, size - n);
+        }
+      case PHY_TRACE_RX_OK:
+        {
+          int n = std::snprintf (buf, size, "r %g %s /NodeList/%u/DeviceList/%u/$ns3::WifiNetDevice/Phy/State/RxOk ",
+                                 r.timeNs / 1e9, m_modes[r.mode], r.node, r.device);
+          return n < 0 || size_t (n) >= size ? n : n + FormatPacket (r, buf + n, size - n);
+        }
+      default:
+        return std::snprintf (buf, size, "? unknown record type %u", r.event);
+      }
+  }
+
+private:
+  static void FormatMac (const uint8_t *a, char *out)
+  {
+    std::snprintf (out, 18, "%02x:%02x:%02x:%02x:%02x:%02x", a[0], a[1], a[2], a[3], a[4], a[5]);
+  }
+
+  int FormatPacket (const PhyTraceRecord &r, char *buf, size_t size)
+  {
+    if (!(r.flags & PHY_TRACE_HAS_MAC))
+      {
+        return std::snprintf (buf, size, "Payload (size=%u)", r.size);
+      }
+    char addr1[18];
+    char addr2[18];
+    FormatMac (r.u.frame.addr1, addr1);
+    FormatMac (r.u.frame.addr2, addr2);
+    return std::snprintf (buf, size, "ns3::WifiMacHeader (%s Retry=%u Duration/ID=%uus, DA=%s, SA=%s, SeqNumber=%u) "
+                          "Payload (size=%u)",
+                          m_macTypes[r.macType], (r.flags & PHY_TRACE_RETRY) ? 1 : 0, r.u.frame.duration,
+                          addr1, addr2, r.u.frame.sequence, r.size);
+  }
+
+  char m_modes[256][24];
+  char m_macTypes[256][24];
+};
+
+/**
+ * Writes the PHY events that WifiPhyHelper::EnableAsciiAll traces as
+ * fixed-size binary records, without formatting anything or needing
+ * packet metadata.  manet-trace-convert renders the file back into the
+ * ASCII trace format with PhyTraceFormatter.
+ */
+class PhyBinaryTrace
+{
+public:
+  PhyBinaryTrace ()
+    : m_file (0),
+      m_nModes (0),
+      m_macTypeDefined (256, false)
+  {
+  }
+
+  ~PhyBinaryTrace ()
+  {
+    Close ();
+  }
+
+  bool Open (std::string fileName)
+  {
+    m_file = std::fopen (fileName.c_str (), "wb");
+    if (m_file == 0)
+      {
+        return false;
+      }
+    std::setvbuf (m_file, 0, _IOFBF, 1024 * 1024);
+    std::fwrite (PHY_TRACE_MAGIC, sizeof (PHY_TRACE_MAGIC), 1, m_file);
+    return true;
+  }
+
+  void Install (NetDeviceContainer devices)
+  {
+    for (uint32_t i = 0; i < devices.GetN (); i++)
+      {
+        Ptr<NetDevice> nd = devices.Get (i);
+        Device device;
+        device.trace = this;
+        device.node = nd->GetNode ()->GetId ();
+        device.device = nd->GetIfIndex ();
+        m_devices.push_back (device);
+
+        std::ostringstream oss;
+        oss << "/NodeList/" << device.node << "/DeviceList/" << device.device << "/$ns3::WifiNetDevice/Phy/State/";
+        Config::ConnectWithoutContext (oss.str () + "Tx", MakeBoundCallback (&PhyBinaryTrace::Tx, &m_devices.back ()));
+        Config::ConnectWithoutContext (oss.str () + "RxOk", MakeBoundCallback (&PhyBinaryTrace::RxOk, &m_devices.back ()));
+      }
+  }
+
+  void Close (void)
+  {
+    if (m_file != 0)
+      {
+        std::fclose (m_file);
+        m_file = 0;
+      }
+  }
+
+private:
+  struct Device
+  {
+    PhyBinaryTrace *trace;
+    uint32_t node;
+    uint32_t device;
+  };
+
+  static void Tx (Device *device, Ptr<const Packet> packet, WifiMode mode,
+                  WifiPreamble preamble, uint8_t txPower)
+  {
+    device->trace->Write (device, PHY_TRACE_TX, packet, mode);
+  }
+
+  static void RxOk (Device *device, Ptr<const Packet> packet, double snr,
+                    WifiMode mode, WifiPreamble preamble)
+  {
+    device->trace->Write (device, PHY_TRACE_RX_OK, packet, mode);
+  }
+
+  void Define (uint8_t event, uint8_t index, std::string name)
+  {
+    PhyTraceRecord record;
+    std::memset (&record, 0, sizeof (record));
+    record.event = event;
+    record.mode = index;
+    record.macType = index;
+    std::strncpy (record.u.name, name.c_str (), sizeof (record.u.name) - 1);
+    std::fwrite (&record, sizeof (record), 1, m_file);
+  }
+
+  void Write (const Device *device, uint8_t event, Ptr<const Packet> packet, WifiMode mode)
+  {
+    if (m_file == 0)
+      {
+        return;
+      }
+
+    uint32_t uid = mode.GetUid ();
+    if (uid >= m_modeIndex.size ())
+      {
+        m_modeIndex.resize (uid + 1, -1);
+      }
+    if (m_modeIndex[uid] < 0)
+      {
+        NS_ABORT_MSG_IF (m_nModes > 255, "Too many WifiModes for the binary PHY trace");
+        m_modeIndex[uid] = m_nModes++;
+        Define (PHY_TRACE_DEFINE_MODE, m_modeIndex[uid], mode.GetUniqueName ());
+      }
+
+    PhyTraceRecord record;
+    std::memset (&record, 0, sizeof (record));
+    record.timeNs = Simulator::Now ().GetNanoSeconds ();
+    record.node = device->node;
+    record.device = device->device;
+    record.event = event;
+    record.mode = m_modeIndex[uid];
+    record.size = packet->GetSize ();
+    record.u.frame.uid = packet->GetUid ();
+
+    // 10 bytes is the shortest MAC header (ACK and CTS)
+    WifiMacHeader hdr;
+    if (packet->GetSize () >= 10 && packet->PeekHeader (hdr) > 0)
+      {
+        uint8_t type = hdr.GetType ();
+        if (!m_macTypeDefined[type])
+          {
+            m_macTypeDefined[type] = true;
+            Define (PHY_TRACE_DEFINE_MAC_TYPE, type, hdr.GetTypeString ());
+          }
+        record.macType = type;
+        record.flags = PHY_TRACE_HAS_MAC | (hdr.IsRetry () ? PHY_TRACE_RETRY : 0);
+        record.u.frame.duration = hdr.GetDuration ().GetMicroSeconds ();
+        if (hdr.IsData () || hdr.IsMgt ())
+          {
+            record.u.frame.sequence = hdr.GetSequenceNumber ();
+          }
+        hdr.GetAddr1 ().CopyTo (record.u.frame.addr1);
+        hdr.GetAddr2 ().CopyTo (record.u.frame.addr2);
+      }
+    std::fwrite (&record, sizeof (record), 1, m_file);
+  }
+
+  std::FILE *m_file;
+  std::list<Device> m_devices;   ///< stable addresses, bound to the trace sinks
+  std::vector<int> m_modeIndex;  ///< by WifiMode uid, -1 if not defined yet
+  uint32_t m_nModes;
+  std::vector<bool> m_macTypeDefined;
+};
+
+} // namespace ns3
+
+#endif /* MANET_PHY_TRACE_H */
@@ -0,0 +1,301 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_PROFILING_SCHEDULER_H
+#define MANET_PROFILING_SCHEDULER_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include "ns3/core-module.h"
+#include "manet-scheduler-decorator.h"
+
+namespace ns3 {
+
+/**
+ * SchedulerDecorator that measures the wall-clock time spent running
+ * each type of event.
+ *
+ * The simulator runs the EventImpl returned by RemoveNext (); this
+ * scheduler returns its own EventImpl instead, which times the real one
+ * around its invocation.  Events are told apart by the dynamic type of
+ * their EventImpl, which MakeEvent derives from the type of the function
+ * or method and of the object they were scheduled with, e.g.
+ * "MakeEvent<void (YansWifiPhy::*)(...), Ptr<YansWifiPhy>, ...>": that
+ * is a signature, not the scheduled function itself, so methods of one
+ * class sharing a signature, e.g. every void (MacLow::*)() event, share
+ * a row.
+ *
+ * When the simulator is destroyed, a table sorted by time is printed to
+ * stdout, and if FoldedFileName is set, the same data is written as
+ * folded stacks (Simulator::Run;<class>;<event type> <microseconds>) for
+ * flame graph tools.
+ */
+class ProfilingScheduler : public SchedulerDecorator
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::ProfilingScheduler")
+      .SetParent<SchedulerDecorator> ()
+      .SetGroupName ("Core")
+      .AddConstructor<ProfilingScheduler> ()
+      .AddAttribute ("FoldedFileName",
+                     "Where to write folded stacks, if anywhere.",
+                     StringValue (""),
+                     MakeStringAccessor (&ProfilingScheduler::m_foldedFileName),
+                     MakeStringChecker ())
+    ;
+    return tid;
+  }
+
+  ProfilingScheduler ()
+    : m_timer (new TimedEvent (this)),
+      m_reported (false)
+  {
+  }
+
+  ~ProfilingScheduler ()
+  {
+    m_timer->Release ();
+    m_timer->Unref ();
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    Event ev = m_inner->RemoveNext ();
+    m_timer->Wrap (ev.impl);
+    // the simulator unrefs what it runs
+    m_timer->Ref ();
+    ev.impl = m_timer;
+    return ev;
+  }
+
+private:
+  struct Stats
+  {
+    Stats ()
+      : events (0),
+        ns (0)
+    {
+    }
+    uint64_t events;
+    uint64_t ns;
+  };
+
+  /// Runs the wrapped event and charges its duration to its type.
+  class TimedEvent : public EventImpl
+  {
+  public:
+    TimedEvent (ProfilingScheduler *owner)
+      : m_owner (owner),
+        m_event (0)
+    {
+    }
+
+    void Wrap (EventImpl *event)
+    {
+      Release ();
+      m_event = event;
+    }
+
+    /// Drop an event that was removed but never run.
+    void Release (void)
+    {
+      if (m_event != 0)
+        {
+          m_event->Unref ();
+          m_event = 0;
+        }
+    }
+
+  private:
+    virtual void Notify (void)
+    {
+      EventImpl *event = m_event;
+      m_event = 0;
+      struct timespec start;
+      struct timespec end;
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      event->Invoke ();
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      Stats &stats = m_owner->m_stats[std::type_index (typeid (*event))];
+      stats.events++;
+      stats.ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+      event->Unref ();
+    }
+
+    ProfilingScheduler *m_owner;
+    EventImpl *m_event;
+  };
+
+  virtual void DoDispose (void)
+  {
+    m_timer->Release ();
+    if (!m_reported)
+      {
+        m_reported = true;
+        Report ();
+      }
+    SchedulerDecorator::DoDispose ();
+  }
+
+  /// \return the demangled type name, without the ns3:: prefixes
+  static std::string GetName (const std::type_index &type)
+  {
+    int status;
+    char *demangled = abi::__cxa_demangle (type.name (), 0, 0, &status);
+    std::string name = status == 0 ? demangled : type.name ();
+    std::free (demangled);
+    std::string::size_type pos;
+    while ((pos = name.find ("ns3::")) != std::string::npos)
+      {
+        name.erase (pos, 5);
+      }
+    // MakeEvent returns an instance of a class local to it, as in
+    // "MakeEvent<A, B>(A, B)::EventMemberImpl0": the class name adds
+    // nothing, nor does the parameter list when the template arguments
+    // already spell it
+    pos = name.rfind ("::");
+    if (pos != std::string::npos && pos > 0 && (name[pos - 1] == ')' || name[pos - 1] == '>'))
+      {
+        name.erase (pos);
+      }
+    std::string::size_type open = FindOpening (name, name.size () - 1, '(', ')');
+    if (open != std::string::npos && open > 0)
+      {
+        std::string::size_type less = FindOpening (name, open - 1, '<', '>');
+        if (less != std::string::npos
+            && Trim (name.substr (less + 1, open - less - 2)) == Trim (name.substr (open + 1, name.size () - open - 2)))
+          {
+            name.erase (open);
+          }
+      }
+    return name;
+  }
+
+  /**
+   * \return the position of the opening bracket matching the closing one
+   *         at end, npos if there is none there
+   */
+  static std::string::size_type FindOpening (const std::string &name, std::string::size_type end,
+                                             char opening, char closing)
+  {
+    if (end >= name.size () || name[end] != closing)
+      {
+        return std::string::npos;
+      }
+    uint32_t depth = 0;
+    for (std::string::size_type i = end + 1; i-- > 0; )
+      {
+        if (name[i] == closing)
+          {
+            depth++;
+          }
+        else if (name[i] == opening && --depth == 0)
+          {
+            return i;
+          }
+      }
+    return std::string::npos;
+  }
+
+  static std::string Trim (const std::string &s)
+  {
+    std::string::size_type end = s.find_last_not_of (' ');
+    return end == std::string::npos ? std::string () : s.substr (0, end + 1);
+  }
+
+  /// \return the first class named in the event type, for grouping
+  static std::string GetClass (const std::string &name)
+  {
+    std::string::size_type pos = name.find ("::*");
+    if (pos == std::string::npos)
+      {
+        return "functions";
+      }
+    std::string::size_type begin = name.find_last_of ("( ,<", pos);
+    return name.substr (begin + 1, pos - begin - 1);
+  }
+
+  void Report (void)
+  {
+    // demangled names, merging any types that print the same
+    std::unordered_map<std::string, Stats> byName;
+    Stats total;
+    for (std::unordered_map<std::type_index, Stats>::const_iterator i = m_stats.begin (); i != m_stats.end (); ++i)
+      {
+        Stats &stats = byName[GetName (i->first)];
+        stats.events += i->second.events;
+        stats.ns += i->second.ns;
+        total.events += i->second.events;
+        total.ns += i->second.ns;
+      }
+    std::vector<std::pair<uint64_t, std::string> > rows;
+    for (std::unordered_map<std::string, Stats>::const_iterator i = byName.begin (); i != byName.end (); ++i)
+      {
+        rows.push_back (std::make_pair (i->second.ns, i->first));
+      }
+    std::sort (rows.rbegin (), rows.rend ());
+
+    std::printf ("%14s %10s %6s %10s  %s\n", "Events", "Seconds", "%", "ns/event", "Event type");
+    for (uint32_t i = 0; i < rows.size (); i++)
+      {
+        const Stats &stats = byName[rows[i].second];
+        PrintRow (stats, total, rows[i].second);
+      }
+    PrintRow (total, total, "total");
+    std::fflush (stdout);
+
+    if (!m_foldedFileName.empty ())
+      {
+        std::ofstream folded (m_foldedFileName.c_str ());
+        NS_ABORT_MSG_UNLESS (folded, "Cannot create " << m_foldedFileName);
+        for (uint32_t i = 0; i < rows.size (); i++)
+          {
+            folded << "Simulator::Run;" << GetClass (rows[i].second) << ";" << rows[i].second
+                   << " " << rows[i].first / 1000 << "\n";
+          }
+      }
+  }
+
+  static void PrintRow (const Stats &stats, const Stats &total, const std::string &name)
+  {
+    std::printf ("%14llu %10.3f %6.2f %10.0f  %s\n", (unsigned long long) stats.events, stats.ns / 1e9,
+                 total.ns > 0 ? 100.0 * stats.ns / total.ns : 0.0,
+                 stats.events > 0 ? double (stats.ns) / stats.events : 0.0, name.c_str ());
+  }
+
+  TimedEvent *m_timer;
+  std::string m_foldedFileName;
+  bool m_reported;
+  std::unordered_map<std::type_index, Stats> m_stats;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (ProfilingScheduler);
+
+} // namespace ns3
+
+#endif /* MANET_PROFILING_SCHEDULER_H */
@@ -0,0 +1,215 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_PROGRESS_SCHEDULER_H
+#define MANET_PROGRESS_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ns3/core-module.h"
+#include "manet-scheduler-decorator.h"
+
+namespace ns3 {
+
+/**
+ * SchedulerDecorator that reports the progress of the simulation on
+ * stderr, every Interval seconds of wall-clock time:
+ *
+ *   progress: sim 42.0/300.0 s (14.0%), wall 00:03:10, events 81234567 (427550/s), ETA 00:19:27
+ *
+ * The simulator thread only stores the timestamp of each event it removes
+ * and the count of events so far, with relaxed atomic stores; a thread of
+ * its own wakes up on a wall-clock timer to print them, so that a stalled
+ * simulation still gets its line.  The rates, and the estimate of the
+ * time left until StopTime, are those of the last interval.
+ *
+ * Events past StopTime are not counted: Simulator::Destroy drains the
+ * ones still pending through RemoveNext without running them, and the
+ * final line is printed after that.
+ */
+class ProgressScheduler : public SchedulerDecorator
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::ProgressScheduler")
+      .SetParent<SchedulerDecorator> ()
+      .SetGroupName ("Core")
+      .AddConstructor<ProgressScheduler> ()
+      .AddAttribute ("Interval",
+                     "Wall-clock seconds between two reports.",
+                     DoubleValue (10.0),
+                     MakeDoubleAccessor (&ProgressScheduler::m_interval),
+                     MakeDoubleChecker<double> (0.1))
+      .AddAttribute ("StopTime",
+                     "Simulated time the simulation stops at, for the estimate of the time left.",
+                     TimeValue (Seconds (0)),
+                     MakeTimeAccessor (&ProgressScheduler::m_stopTime),
+                     MakeTimeChecker ())
+    ;
+    return tid;
+  }
+
+  ProgressScheduler ()
+    : m_interval (10.0),
+      m_stopSteps (0),
+      m_events (0),
+      m_ts (0),
+      m_eventsSeen (0),
+      m_stop (false)
+  {
+  }
+
+  ~ProgressScheduler ()
+  {
+    Stop ();
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    Event ev = m_inner->RemoveNext ();
+    if (!m_thread.joinable ())
+      {
+        // attributes are only known after construction
+        Start ();
+      }
+    if (m_stopSteps > 0 && uint64_t (ev.key.m_ts) > m_stopSteps)
+      {
+        return ev;
+      }
+    // only this thread writes, so there is no need for a read-modify-write
+    m_ts.store (ev.key.m_ts, std::memory_order_relaxed);
+    m_events.store (++m_eventsSeen, std::memory_order_relaxed);
+    return ev;
+  }
+
+private:
+  virtual void DoDispose (void)
+  {
+    Stop ();
+    SchedulerDecorator::DoDispose ();
+  }
+
+  void Start (void)
+  {
+    // Time conversions read global state: do them here, not in the thread
+    m_secondsPerStep = TimeStep (1).GetSeconds ();
+    m_stopSeconds = m_stopTime.GetSeconds ();
+    m_stopSteps = m_stopTime.GetTimeStep ();
+    m_stop = false;
+    m_thread = std::thread (&ProgressScheduler::Report, this);
+  }
+
+  void Stop (void)
+  {
+    if (!m_thread.joinable ())
+      {
+        return;
+      }
+    {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      m_stop = true;
+    }
+    m_wakeup.notify_one ();
+    m_thread.join ();
+  }
+
+  void Report (void)
+  {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now ();
+    Clock::time_point last = start;
+    uint64_t lastEvents = 0;
+    double lastSim = 0;
+    std::unique_lock<std::mutex> lock (m_mutex);
+    for (;;)
+      {
+        bool stop = m_wakeup.wait_for (lock, std::chrono::duration<double> (m_interval),
+                                       [this] () { return m_stop; });
+        Clock::time_point now = Clock::now ();
+        uint64_t events = m_events.load (std::memory_order_relaxed);
+        double sim = m_ts.load (std::memory_order_relaxed) * m_secondsPerStep;
+        double elapsed = std::chrono::duration<double> (now - last).count ();
+        double eventRate = elapsed > 0 ? (events - lastEvents) / elapsed : 0;
+        double simRate = elapsed > 0 ? (sim - lastSim) / elapsed : 0;
+
+        char eta[16];
+        if (stop)
+          {
+            std::snprintf (eta, sizeof (eta), "done");
+          }
+        else if (m_stopSeconds > sim && simRate > 0)
+          {
+            FormatSeconds ((m_stopSeconds - sim) / simRate, eta, sizeof (eta));
+          }
+        else
+          {
+            std::snprintf (eta, sizeof (eta), "--:--:--");
+          }
+        char wall[16];
+        FormatSeconds (std::chrono::duration<double> (now - start).count (), wall, sizeof (wall));
+        if (m_stopSeconds > 0)
+          {
+            std::fprintf (stderr, "progress: sim %.1f/%.1f s (%.1f%%), wall %s, events %llu (%.0f/s), ETA %s\n",
+                          sim, m_stopSeconds, 100.0 * sim / m_stopSeconds, wall,
+                          (unsigned long long) events, eventRate, eta);
+          }
+        else
+          {
+            std::fprintf (stderr, "progress: sim %.1f s, wall %s, events %llu (%.0f/s)\n",
+                          sim, wall, (unsigned long long) events, eventRate);
+          }
+        if (stop)
+          {
+            break;
+          }
+        last = now;
+        lastEvents = events;
+        lastSim = sim;
+      }
+  }
+
+  static void FormatSeconds (double seconds, char *buf, size_t size)
+  {
+    uint64_t s = seconds;
+    std::snprintf (buf, size, "%02llu:%02u:%02u", (unsigned long long) (s / 3600),
+                   unsigned (s / 60 % 60), unsigned (s % 60));
+  }
+
+  double m_interval;
+  Time m_stopTime;
+  double m_secondsPerStep;
+  double m_stopSeconds;
+  uint64_t m_stopSteps;               ///< StopTime, 0 if unset
+  std::atomic<uint64_t> m_events;
+  std::atomic<uint64_t> m_ts;
+  uint64_t m_eventsSeen;
+  bool m_stop;                        ///< guarded by m_mutex
+  std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  std::thread m_thread;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (ProgressScheduler);
+
+} // namespace ns3
+
+#endif /* MANET_PROGRESS_SCHEDULER_H */
@@ -0,0 +1,346 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_ROUTING_OVERHEAD_H
+#define MANET_ROUTING_OVERHEAD_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "manet-metrics-writer.h"
+
+namespace ns3 {
+
+/// Routing control message classes counted by RoutingOverhead.
+enum RoutingMessageType
+{
+  ROUTING_AODV_RREQ,
+  ROUTING_AODV_RREP,
+  ROUTING_AODV_RERR,
+  ROUTING_AODV_RREP_ACK,
+  ROUTING_AODV_HELLO,
+  ROUTING_OLSR_HELLO,
+  ROUTING_OLSR_TC,
+  ROUTING_OLSR_MID,
+  ROUTING_OLSR_HNA,
+  ROUTING_DSDV_UPDATE,
+  ROUTING_DSR_RREQ,
+  ROUTING_DSR_RREP,
+  ROUTING_DSR_RERR,
+  ROUTING_DSR_ACK,
+  ROUTING_DSR_ACK_REQ,
+  ROUTING_OTHER,       ///< routing traffic of a type not listed above
+  ROUTING_MESSAGE_TYPES
+};
+
+/**
+ * Counts the routing control packets and bytes every node sends.
+ *
+ * Every IPv4 packet a node transmits, including the ones it forwards, is
+ * seen on the Ipv4L3Protocol Tx trace and classified from its raw bytes:
+ * UDP port 654 is AODV, 698 is OLSR, 269 is DSDV, and IP protocol 48
+ * packets with a DSR control message type are DSR.  Bytes are IP packet
+ * sizes, so they include the IP and UDP headers but no MAC framing.  An
+ * OLSR packet may bundle several messages: each message type is counted
+ * its own size, and the packet itself (with its headers) is counted
+ * under its first message.
+ *
+ * The counters cover one interval; EndInterval () writes and resets them.
+ */
+class RoutingOverhead
+{
+public:
+  RoutingOverhead ()
+    : m_packets (0),
+      m_bytes (0)
+  {
+  }
+
+  void Install (NodeContainer nodes)
+  {
+    uint32_t maxId = 0;
+    for (uint32_t i = 0; i < nodes.GetN (); i++)
+      {
+        maxId = std::max (maxId, nodes.Get (i)->GetId ());
+      }
+    m_counters.assign ((maxId + 1) * ROUTING_MESSAGE_TYPES, Counter ());
+    for (uint32_t i = 0; i < nodes.GetN (); i++)
+      {
+        Ptr<Ipv4L3Protocol> ipv4 = nodes.Get (i)->GetObject<Ipv4L3Protocol> ();
+        NS_ABORT_MSG_IF (ipv4 == 0, "RoutingOverhead needs the internet stack installed");
+        ipv4->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&RoutingOverhead::Tx, this,
+                                                                   nodes.Get (i)->GetId ()));
+      }
+  }
+
+  /// \return the routing control packets sent by all nodes in this interval
+  uint64_t GetPackets (void) const
+  {
+    return m_packets;
+  }
+
+  /// \return the routing control bytes sent by all nodes in this interval
+  uint64_t GetBytes (void) const
+  {
+    return m_bytes;
+  }
+
+  /// \return the routing control bytes sent by node in this interval
+  uint64_t GetNodeBytes (uint32_t node) const
+  {
+    uint64_t bytes = 0;
+    for (uint32_t i = node * ROUTING_MESSAGE_TYPES;
+         i < (node + 1) * ROUTING_MESSAGE_TYPES && i < m_counters.size (); i++)
+      {
+        bytes += m_counters[i].bytes;
+      }
+    return bytes;
+  }
+
+  /**
+   * Write one row per node and message type sent in this interval
+   * (Node,MessageType,Packets,Bytes after the time column) and reset the
+   * counters.
+   */
+  void EndInterval (MetricsWriter &writer, double now)
+  {
+    for (uint32_t i = 0; i < m_counters.size (); i++)
+      {
+        Counter &counter = m_counters[i];
+        if (counter.packets == 0 && counter.bytes == 0)
+          {
+            continue;
+          }
+        if (writer.IsOpen ())
+          {
+            writer.AddDouble (now)
+              .AddUint (i / ROUTING_MESSAGE_TYPES)
+              .AddString (GetTypeName (RoutingMessageType (i % ROUTING_MESSAGE_TYPES)))
+              .AddUint (counter.packets)
+              .AddUint (counter.bytes);
+            writer.EndRow (now);
+          }
+        counter = Counter ();
+      }
+    m_packets = 0;
+    m_bytes = 0;
+  }
+
+  static const char *GetTypeName (RoutingMessageType type)
+  {
+    static const char *names[ROUTING_MESSAGE_TYPES] = {
+      "AODV_RREQ", "AODV_RREP", "AODV_RERR", "AODV_RREP_ACK", "AODV_HELLO",
+      "OLSR_HELLO", "OLSR_TC", "OLSR_MID", "OLSR_HNA",
+      "DSDV_UPDATE",
+      "DSR_RREQ", "DSR_RREP", "DSR_RERR", "DSR_ACK", "DSR_ACK_REQ",
+      "OTHER"
+    };
+    return names[type];
+  }
+
+private:
+  struct Counter
+  {
+    Counter ()
+      : packets (0),
+        bytes (0)
+    {
+    }
+    uint64_t packets;
+    uint64_t bytes;
+  };
+
+  enum
+  {
+    IP_PROTOCOL_UDP = 17,
+    IP_PROTOCOL_DSR = 48,
+    AODV_PORT = 654,
+    OLSR_PORT = 698,
+    DSDV_PORT = 269,
+    /// enough for the IP header and the start of any control message
+    PEEK_BYTES = 64
+  };
+
+  static void Tx (RoutingOverhead *self, uint32_t node, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    self->Classify (node, packet);
+  }
+
+  void Count (uint32_t node, RoutingMessageType type, uint32_t packets, uint32_t bytes)
+  {
+    Counter &counter = m_counters[node * ROUTING_MESSAGE_TYPES + type];
+    counter.packets += packets;
+    counter.bytes += bytes;
+    m_packets += packets;
+    m_bytes += bytes;
+  }
+
+  void Classify (uint32_t node, Ptr<const Packet> packet)
+  {
+    uint32_t size = packet->GetSize ();
+    uint8_t buf[PEEK_BYTES];
+    uint32_t n = packet->CopyData (buf, PEEK_BYTES);
+    if (n < 20)
+      {
+        return;
+      }
+    uint32_t ihl = (buf[0] & 0x0f) * 4;
+    uint8_t protocol = buf[9];
+    if (protocol == IP_PROTOCOL_DSR)
+      {
+        ClassifyDsr (node, buf + ihl, n - std::min (n, ihl), size);
+        return;
+      }
+    if (protocol != IP_PROTOCOL_UDP || n < ihl + 8)
+      {
+        return;
+      }
+    uint16_t port = (buf[ihl + 2] << 8) | buf[ihl + 3];
+    const uint8_t *payload = buf + ihl + 8;
+    uint32_t available = n - ihl - 8;
+    switch (port)
+      {
+      case AODV_PORT:
+        ClassifyAodv (node, payload, available, size);
+        break;
+      case OLSR_PORT:
+        ClassifyOlsr (node, packet, ihl + 8, size);
+        break;
+      case DSDV_PORT:
+        Count (node, ROUTING_DSDV_UPDATE, 1, size);
+        break;
+      default:
+        break;
+      }
+  }
+
+  void ClassifyAodv (uint32_t node, const uint8_t *payload, uint32_t available, uint32_t size)
+  {
+    RoutingMessageType type = ROUTING_OTHER;
+    switch (available > 0 ? payload[0] : 0)
+      {
+      case 1:
+        type = ROUTING_AODV_RREQ;
+        break;
+      case 2:
+        // hellos are RREPs whose destination is their originator: type
+        // (1), flags (1), prefix size (1), hop count (1), destination (4),
+        // destination sequence number (4), originator (4), ...
+        type = available >= 16 && std::memcmp (payload + 4, payload + 12, 4) == 0
+          ? ROUTING_AODV_HELLO : ROUTING_AODV_RREP;
+        break;
+      case 3:
+        type = ROUTING_AODV_RERR;
+        break;
+      case 4:
+        type = ROUTING_AODV_RREP_ACK;
+        break;
+      }
+    Count (node, type, 1, size);
+  }
+
+  void ClassifyOlsr (uint32_t node, Ptr<const Packet> packet, uint32_t offset, uint32_t size)
+  {
+    // OLSR packets are small; copy the whole packet to walk its messages
+    m_scratch.resize (size);
+    packet->CopyData (&m_scratch[0], size);
+    // packet header: length (2), sequence number (2); message header:
+    // type (1), vtime (1), size (2), ...
+    uint32_t pos = offset + 4;
+    uint32_t counted = 0;
+    bool first = true;
+    while (pos + 4 <= size)
+      {
+        uint16_t messageSize = (m_scratch[pos + 2] << 8) | m_scratch[pos + 3];
+        if (messageSize < 4 || pos + messageSize > size)
+          {
+            break;
+          }
+        RoutingMessageType type = ROUTING_OTHER;
+        switch (m_scratch[pos])
+          {
+          case 1:
+            type = ROUTING_OLSR_HELLO;
+            break;
+          case 2:
+            type = ROUTING_OLSR_TC;
+            break;
+          case 3:
+            type = ROUTING_OLSR_MID;
+            break;
+          case 4:
+            type = ROUTING_OLSR_HNA;
+            break;
+          }
+        uint32_t bytes = messageSize;
+        if (first)
+          {
+            bytes += pos;
+          }
+        Count (node, type, first ? 1 : 0, bytes);
+        counted += bytes;
+        first = false;
+        pos += messageSize;
+      }
+    if (counted < size)
+      {
+        Count (node, ROUTING_OTHER, first ? 1 : 0, size - counted);
+      }
+  }
+
+  void ClassifyDsr (uint32_t node, const uint8_t *dsr, uint32_t available, uint32_t size)
+  {
+    // fixed header: next header (1), message type (1, 1 for control and
+    // 2 for data), source id (2), destination id (2), payload length (2),
+    // then the first option type
+    if (available < 9 || dsr[1] != 1)
+      {
+        return;
+      }
+    RoutingMessageType type = ROUTING_OTHER;
+    switch (dsr[8])
+      {
+      case 1:
+        type = ROUTING_DSR_RREQ;
+        break;
+      case 2:
+        type = ROUTING_DSR_RREP;
+        break;
+      case 3:
+        type = ROUTING_DSR_RERR;
+        break;
+      case 32:
+        type = ROUTING_DSR_ACK;
+        break;
+      case 160:
+        type = ROUTING_DSR_ACK_REQ;
+        break;
+      }
+    Count (node, type, 1, size);
+  }
+
+  std::vector<Counter> m_counters;
+  std::vector<uint8_t> m_scratch;
+  uint64_t m_packets;
+  uint64_t m_bytes;
+};
+
+} // namespace ns3
+
+#endif /* MANET_ROUTING_OVERHEAD_H */
@@ -0,0 +1,154 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_ROUTING_REGISTRY_H
+#define MANET_ROUTING_REGISTRY_H
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/aodv-module.h"
+#include "ns3/olsr-module.h"
+#include "ns3/dsdv-module.h"
+#include "ns3/dsr-module.h"
+
+namespace ns3 {
+
+/**
+ * The routing protocols the scenario can run, by number and by name.
+ *
+ * Each protocol comes with the function that installs the internet stack
+ * with it on a set of nodes.  The stack helper is passed in configured
+ * (TCP variant and so on) but without a routing helper; list routing
+ * protocols go next to static routing, as in the ns-3 examples, while
+ * DSR is installed on top of the default stack.
+ *
+ * Other protocols can be added with Register () before the scenario
+ * runs.
+ */
+class RoutingRegistry
+{
+public:
+  typedef void (*Installer) (InternetStackHelper &internet, NodeContainer nodes);
+
+  struct Protocol
+  {
+    uint32_t id;
+    std::string name;
+    Installer install;
+  };
+
+  /// \return the registry, with OLSR (1), AODV (2), DSDV (3) and DSR (4)
+  static RoutingRegistry &Get (void)
+  {
+    static RoutingRegistry registry;
+    return registry;
+  }
+
+  void Register (uint32_t id, std::string name, Installer install)
+  {
+    NS_ABORT_MSG_IF (Find (name) != 0, "Routing protocol " << name << " registered twice");
+    Protocol protocol;
+    protocol.id = id;
+    protocol.name = name;
+    protocol.install = install;
+    m_protocols.push_back (protocol);
+  }
+
+  /// \return the protocol with this number or (case-sensitive) name, or 0
+  const Protocol *Find (std::string key) const
+  {
+    char *end;
+    unsigned long id = std::strtoul (key.c_str (), &end, 10);
+    bool numeric = !key.empty () && *end == 0;
+    for (std::vector<Protocol>::const_iterator i = m_protocols.begin (); i != m_protocols.end (); ++i)
+      {
+        if (numeric ? i->id == id : i->name == key)
+          {
+            return &*i;
+          }
+      }
+    return 0;
+  }
+
+  /// \return "1 (OLSR), 2 (AODV), ..." for help and error messages
+  std::string List (void) const
+  {
+    std::ostringstream oss;
+    for (std::vector<Protocol>::const_iterator i = m_protocols.begin (); i != m_protocols.end (); ++i)
+      {
+        oss << (i == m_protocols.begin () ? "" : ", ") << i->id << " (" << i->name << ")";
+      }
+    return oss.str ();
+  }
+
+private:
+  RoutingRegistry ()
+  {
+    Register (1, "OLSR", &InstallOlsr);
+    Register (2, "AODV", &InstallAodv);
+    Register (3, "DSDV", &InstallDsdv);
+    Register (4, "DSR", &InstallDsr);
+  }
+
+  static void InstallListRouting (InternetStackHelper &internet, NodeContainer nodes,
+                                  const Ipv4RoutingHelper &routing)
+  {
+    Ipv4StaticRoutingHelper staticRouting;
+    Ipv4ListRoutingHelper list;
+    list.Add (staticRouting, 0);
+    list.Add (routing, 100);
+    internet.SetRoutingHelper (list);
+    internet.Install (nodes);
+  }
+
+  static void InstallOlsr (InternetStackHelper &internet, NodeContainer nodes)
+  {
+    OlsrHelper olsr;
+    InstallListRouting (internet, nodes, olsr);
+  }
+
+  static void InstallAodv (InternetStackHelper &internet, NodeContainer nodes)
+  {
+    AodvHelper aodv;
+    InstallListRouting (internet, nodes, aodv);
+  }
+
+  static void InstallDsdv (InternetStackHelper &internet, NodeContainer nodes)
+  {
+    DsdvHelper dsdv;
+    InstallListRouting (internet, nodes, dsdv);
+  }
+
+  static void InstallDsr (InternetStackHelper &internet, NodeContainer nodes)
+  {
+    // DSR is a layer above IP, not an Ipv4RoutingProtocol
+    internet.Install (nodes);
+    DsrHelper dsr;
+    DsrMainHelper dsrMain;
+    dsrMain.Install (dsr, nodes);
+  }
+
+  std::vector<Protocol> m_protocols;
+};
+
+} // namespace ns3
+
+#endif /* MANET_ROUTING_REGISTRY_H */
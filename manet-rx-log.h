@@ -0,0 +1,202 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_RX_LOG_H
+#define MANET_RX_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * One packet reception, as written to a binary receive log.
+ *
+ * The file starts with RX_LOG_MAGIC and is followed by records in host
+ * byte order.  manet-trace-convert renders it to the text lines the
+ * scenario prints in text mode.
+ */
+struct RxLogRecord
+{
+  int64_t timeNs;   ///< reception time
+  uint32_t node;    ///< receiving node id
+  uint32_t from;    ///< sender IPv4 address, host order
+  uint32_t size;    ///< packet size in bytes
+  uint32_t flags;   ///< RX_LOG_FROM_INET if from is valid
+};
+
+static const char RX_LOG_MAGIC[8] = { 'M', 'R', 'X', 'L', 'O', 'G', '0', '1' };
+static const uint32_t RX_LOG_FROM_INET = 1;
+
+/**
+ * Render one record in the format of the scenario's text receive log.
+ *
+ * \return the number of characters written to buf, not counting the
+ *         terminating null byte
+ */
+inline int
+FormatRxLogRecord (const RxLogRecord &r, char *buf, size_t size)
+{
+  if (r.flags & RX_LOG_FROM_INET)
+    {
+      return std::snprintf (buf, size, "%g %u received one packet from %u.%u.%u.%u",
+                            r.timeNs / 1e9, r.node,
+                            (r.from >> 24) & 0xff, (r.from >> 16) & 0xff,
+                            (r.from >> 8) & 0xff, r.from & 0xff);
+    }
+  return std::snprintf (buf, size, "%g %u received one packet!", r.timeNs / 1e9, r.node);
+}
+
+/**
+ * Binary receive log.
+ *
+ * The simulator thread copies fixed-size records into a single-producer
+ * single-consumer ring; a background thread drains the ring to disk in
+ * large writes.  Log () only blocks if the ring is full, i.e. if the disk
+ * cannot keep up, and never allocates or formats anything.
+ */
+class RxLogWriter
+{
+public:
+  RxLogWriter ()
+    : m_file (0),
+      m_mask (0),
+      m_head (0),
+      m_tail (0),
+      m_stop (false),
+      m_stalls (0)
+  {
+  }
+
+  ~RxLogWriter ()
+  {
+    Close ();
+  }
+
+  /**
+   * \param fileName the binary log file
+   * \param capacity ring size in records, rounded up to a power of two
+   *        (at most 2^31)
+   * \return false if the file cannot be created
+   */
+  bool Open (const std::string &fileName, uint32_t capacity)
+  {
+    Close ();
+    m_file = std::fopen (fileName.c_str (), "wb");
+    if (m_file == 0)
+      {
+        return false;
+      }
+    std::fwrite (RX_LOG_MAGIC, sizeof (RX_LOG_MAGIC), 1, m_file);
+
+    // at most 2^31 records, past which the round-up would overflow
+    uint32_t size = 1;
+    while (size < capacity && size < (1u << 31))
+      {
+        size <<= 1;
+      }
+    m_ring.resize (size);
+    m_mask = size - 1;
+    m_head.store (0);
+    m_tail.store (0);
+    m_stop.store (false);
+    m_stalls = 0;
+    m_thread = std::thread (&RxLogWriter::Drain, this);
+    return true;
+  }
+
+  void Log (const RxLogRecord &record)
+  {
+    uint64_t head = m_head.load (std::memory_order_relaxed);
+    if (head - m_tail.load (std::memory_order_acquire) > m_mask)
+      {
+        m_stalls++;
+        while (head - m_tail.load (std::memory_order_acquire) > m_mask)
+          {
+            std::this_thread::yield ();
+          }
+      }
+    m_ring[head & m_mask] = record;
+    m_head.store (head + 1, std::memory_order_release);
+  }
+
+  /// \return how often Log () had to wait for the drain thread
+  uint64_t GetStalls (void) const
+  {
+    return m_stalls;
+  }
+
+  /// Drain what is left in the ring and close the file.
+  void Close (void)
+  {
+    if (m_file == 0)
+      {
+        return;
+      }
+    m_stop.store (true, std::memory_order_release);
+    m_thread.join ();
+    std::fclose (m_file);
+    m_file = 0;
+  }
+
+private:
+  void Drain (void)
+  {
+    for (;;)
+      {
+        // read the stop flag first, so that every record logged before
+        // Close () is seen by the final pass
+        bool stop = m_stop.load (std::memory_order_acquire);
+        uint64_t tail = m_tail.load (std::memory_order_relaxed);
+        uint64_t head = m_head.load (std::memory_order_acquire);
+        while (tail != head)
+          {
+            // write up to the end of the ring in one go
+            uint64_t index = tail & m_mask;
+            uint64_t n = std::min<uint64_t> (head - tail, m_ring.size () - index);
+            std::fwrite (&m_ring[index], sizeof (RxLogRecord), n, m_file);
+            tail += n;
+            m_tail.store (tail, std::memory_order_release);
+          }
+        if (stop)
+          {
+            break;
+          }
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+      }
+    std::fflush (m_file);
+  }
+
+  std::FILE *m_file;
+  std::vector<RxLogRecord> m_ring;
+  uint64_t m_mask;
+  std::atomic<uint64_t> m_head;
+  std::atomic<uint64_t> m_tail;
+  std::atomic<bool> m_stop;
+  uint64_t m_stalls;
+  std::thread m_thread;
+};
+
+} // namespace ns3
+
+#endif /* MANET_RX_LOG_H */
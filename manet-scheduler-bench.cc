@@ -0,0 +1,178 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Replays the event stream of a my-manet-routing-compare run, recorded
+ * with --schedulerLog, under each scheduler and reports how fast each one
+ * processes it and how much memory it needs at its peak.
+ *
+ *   ./waf --run "my-manet-routing-compare --nWifis=100 --schedulerLog=events.log"
+ *   ./waf --run "manet-scheduler-bench --log=events.log"
+ *
+ * Only the schedulers are exercised: every insertion, removal of the
+ * next event and cancellation is applied in the recorded order, with no
+ * event actually run.  Each scheduler is replayed in a child process of
+ * its own, whose peak resident set size above its size before the replay
+ * is reported.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "manet-ladder-scheduler.h"
+#include "manet-scheduler-decorator.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ManetSchedulerBench");
+
+/// \return the current resident set size in KiB
+static long
+GetRssKib (void)
+{
+  long pages = 0;
+  long resident = 0;
+  std::FILE *statm = std::fopen ("/proc/self/statm", "r");
+  if (statm != 0)
+    {
+      if (std::fscanf (statm, "%ld %ld", &pages, &resident) != 2)
+        {
+          resident = 0;
+        }
+      std::fclose (statm);
+    }
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static double
+GetWallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/// Replay the log under one scheduler and print its result row.
+static int
+Replay (std::string log, std::string scheduler)
+{
+  std::FILE *in = std::fopen (log.c_str (), "rb");
+  if (in == 0)
+    {
+      std::cerr << "Cannot open " << log << std::endl;
+      return 1;
+    }
+  char magic[8];
+  if (std::fread (magic, sizeof (magic), 1, in) != 1
+      || std::memcmp (magic, SCHEDULER_LOG_MAGIC, sizeof (magic)) != 0)
+    {
+      std::cerr << log << " is not a scheduler log" << std::endl;
+      return 1;
+    }
+
+  ObjectFactory factory;
+  factory.SetTypeId (scheduler);
+  Ptr<Scheduler> events = factory.Create<Scheduler> ();
+
+  // read in small chunks, so that the log does not count as memory
+  static SchedulerLogRecord records[4096];
+  long baseline = GetRssKib ();
+  uint64_t removed = 0;
+  uint64_t operations = 0;
+  double start = GetWallSeconds ();
+  size_t n;
+  while ((n = std::fread (records, sizeof (SchedulerLogRecord), 4096, in)) > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+        {
+          Scheduler::Event ev;
+          ev.impl = 0;
+          ev.key.m_ts = records[i].ts;
+          ev.key.m_uid = records[i].uid;
+          ev.key.m_context = records[i].context;
+          switch (records[i].op)
+            {
+            case SCHEDULER_LOG_INSERT:
+              events->Insert (ev);
+              break;
+            case SCHEDULER_LOG_REMOVE_NEXT:
+              events->RemoveNext ();
+              removed++;
+              break;
+            case SCHEDULER_LOG_REMOVE:
+              events->Remove (ev);
+              break;
+            }
+        }
+      operations += n;
+    }
+  double elapsed = GetWallSeconds () - start;
+  std::fclose (in);
+
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  std::cout << scheduler << "," << operations << "," << removed << "," << elapsed << ","
+            << (elapsed > 0 ? removed / elapsed : 0) << "," << usage.ru_maxrss - baseline << std::endl;
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string log ("scheduler.log");
+  std::string schedulers ("ns3::MapScheduler,ns3::HeapScheduler,ns3::CalendarScheduler,ns3::LadderScheduler");
+
+  CommandLine cmd;
+  cmd.AddValue ("log", "Scheduler log written by my-manet-routing-compare --schedulerLog", log);
+  cmd.AddValue ("schedulers", "Comma separated scheduler TypeIds to compare", schedulers);
+  cmd.Parse (argc, argv);
+
+  std::cout << "Scheduler,Operations,Events,Seconds,EventsPerSecond,PeakMemoryKiB" << std::endl;
+  std::istringstream list (schedulers);
+  std::string scheduler;
+  int failed = 0;
+  while (std::getline (list, scheduler, ','))
+    {
+      std::cout.flush ();
+      pid_t pid = fork ();
+      NS_ABORT_MSG_IF (pid < 0, "fork failed: " << std::strerror (errno));
+      if (pid == 0)
+        {
+          _exit (Replay (log, scheduler));
+        }
+      int status;
+      while (waitpid (pid, &status, 0) < 0)
+        {
+          NS_ABORT_MSG_IF (errno != EINTR, "waitpid failed: " << std::strerror (errno));
+        }
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          std::cerr << scheduler << " failed" << std::endl;
+          failed++;
+        }
+    }
+  return failed == 0 ? 0 : 1;
+}
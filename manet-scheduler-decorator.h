@@ -0,0 +1,218 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_SCHEDULER_DECORATOR_H
+#define MANET_SCHEDULER_DECORATOR_H
+
+#include <cstdio>
+#include <string>
+#include "ns3/core-module.h"
+#include "ns3/scheduler.h"
+
+namespace ns3 {
+
+/**
+ * Scheduler that forwards every call to another one, the Inner
+ * attribute, so that subclasses can observe the event stream of any
+ * scheduler type.  Inner is an ObjectFactory, so decorators can be
+ * nested, e.g. "ns3::RecordingScheduler[FileName=a.log|Inner=ns3::HeapScheduler]".
+ */
+class SchedulerDecorator : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::SchedulerDecorator")
+      .SetParent<Scheduler> ()
+      .SetGroupName ("Core")
+      .AddAttribute ("Inner",
+                     "Factory of the scheduler that holds the events.",
+                     ObjectFactoryValue (GetDefaultInner ()),
+                     MakeObjectFactoryAccessor (&SchedulerDecorator::SetInner),
+                     MakeObjectFactoryChecker ())
+    ;
+    return tid;
+  }
+
+  void SetInner (ObjectFactory factory)
+  {
+    NS_ASSERT (m_inner == 0 || m_inner->IsEmpty ());
+    m_inner = factory.Create<Scheduler> ();
+  }
+
+  virtual void Insert (const Event &ev)
+  {
+    m_inner->Insert (ev);
+  }
+
+  virtual bool IsEmpty (void) const
+  {
+    return m_inner->IsEmpty ();
+  }
+
+  virtual Event PeekNext (void) const
+  {
+    return m_inner->PeekNext ();
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    return m_inner->RemoveNext ();
+  }
+
+  virtual void Remove (const Event &ev)
+  {
+    m_inner->Remove (ev);
+  }
+
+protected:
+  virtual void DoDispose (void)
+  {
+    m_inner = 0;
+    Scheduler::DoDispose ();
+  }
+
+  static ObjectFactory GetDefaultInner (void)
+  {
+    ObjectFactory factory;
+    factory.SetTypeId ("ns3::MapScheduler");
+    return factory;
+  }
+
+  Ptr<Scheduler> m_inner;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (SchedulerDecorator);
+
+/**
+ * Scheduler operation log, as written by RecordingScheduler: the
+ * SCHEDULER_LOG_MAGIC bytes, then fixed-size SchedulerLogRecord entries
+ * in host byte order.
+ */
+enum SchedulerLogOp
+{
+  SCHEDULER_LOG_INSERT = 'i',
+  SCHEDULER_LOG_REMOVE_NEXT = 'n',
+  SCHEDULER_LOG_REMOVE = 'r'
+};
+
+struct SchedulerLogRecord
+{
+  uint64_t ts;
+  uint32_t uid;
+  uint32_t context;
+  uint32_t op;        ///< a SchedulerLogOp
+  uint32_t reserved;
+};
+
+static const char SCHEDULER_LOG_MAGIC[8] = { 'M', 'S', 'C', 'H', 'E', 'D', '0', '1' };
+
+/**
+ * SchedulerDecorator that logs every insertion and removal to FileName,
+ * so that manet-scheduler-bench can replay the exact event stream of a
+ * run under other schedulers.
+ */
+class RecordingScheduler : public SchedulerDecorator
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::RecordingScheduler")
+      .SetParent<SchedulerDecorator> ()
+      .SetGroupName ("Core")
+      .AddConstructor<RecordingScheduler> ()
+      .AddAttribute ("FileName",
+                     "Where to write the log.",
+                     StringValue ("scheduler.log"),
+                     MakeStringAccessor (&RecordingScheduler::m_fileName),
+                     MakeStringChecker ())
+    ;
+    return tid;
+  }
+
+  RecordingScheduler ()
+    : m_file (0)
+  {
+  }
+
+  ~RecordingScheduler ()
+  {
+    Close ();
+  }
+
+  virtual void Insert (const Event &ev)
+  {
+    Log (SCHEDULER_LOG_INSERT, ev);
+    m_inner->Insert (ev);
+  }
+
+  virtual Event RemoveNext (void)
+  {
+    Event ev = m_inner->RemoveNext ();
+    Log (SCHEDULER_LOG_REMOVE_NEXT, ev);
+    return ev;
+  }
+
+  virtual void Remove (const Event &ev)
+  {
+    Log (SCHEDULER_LOG_REMOVE, ev);
+    m_inner->Remove (ev);
+  }
+
+private:
+  virtual void DoDispose (void)
+  {
+    Close ();
+    SchedulerDecorator::DoDispose ();
+  }
+
+  void Log (SchedulerLogOp op, const Event &ev)
+  {
+    if (m_file == 0)
+      {
+        // attributes are only known after construction
+        m_file = std::fopen (m_fileName.c_str (), "wb");
+        NS_ABORT_MSG_IF (m_file == 0, "Cannot create " << m_fileName);
+        std::setvbuf (m_file, 0, _IOFBF, 1 << 20);
+        std::fwrite (SCHEDULER_LOG_MAGIC, sizeof (SCHEDULER_LOG_MAGIC), 1, m_file);
+      }
+    SchedulerLogRecord record;
+    record.ts = ev.key.m_ts;
+    record.uid = ev.key.m_uid;
+    record.context = ev.key.m_context;
+    record.op = op;
+    record.reserved = 0;
+    std::fwrite (&record, sizeof (record), 1, m_file);
+  }
+
+  void Close (void)
+  {
+    if (m_file != 0)
+      {
+        std::fclose (m_file);
+        m_file = 0;
+      }
+  }
+
+  std::string m_fileName;
+  std::FILE *m_file;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (RecordingScheduler);
+
+} // namespace ns3
+
+#endif /* MANET_SCHEDULER_DECORATOR_H */
@@ -0,0 +1,347 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Parameter sweep driver for my-manet-routing-compare.
+ *
+ * The grid is a text file with one scenario parameter per line, named as
+ * on the scenario command line, followed by the comma separated values to
+ * sweep over:
+ *
+ *   # protocol x density x speed x txp x seed
+ *   protocol = 1, 2, 3
+ *   nWifis = 15, 30
+ *   nodeSpeed = 5, 20
+ *   txp = 7.5
+ *   RngRun = 1, 2, 3, 4, 5
+ *
+ * Every point of the cartesian product is run as a separate process of the
+ * scenario program, at most --jobs at a time (by default one per core).
+ * Each point writes its own CSV file and log into --outDir; once all points
+ * are done the CSV files are merged into a single table, prefixed with the
+ * point number and the value of every swept parameter.  With
+ * --metricsPort=N, point i serves its live counters on port N + i for
+ * Prometheus while it runs.
+ *
+ * Seeds are swept through RngRun, as the scenario's replications cannot
+ * be: their -rep<i> outputs and ports do not fit the merge and the port
+ * numbering above.
+ *
+ *   ./waf --run "manet-sweep --grid=nightly.grid --outDir=nightly"
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ManetSweep");
+
+struct SweepParameter
+{
+  std::string name;
+  std::vector<std::string> values;
+};
+
+struct SweepPoint
+{
+  uint32_t index;
+  std::vector<std::string> values; // one per SweepParameter
+  std::string csvFileName;
+  std::string logFileName;
+  int status;
+};
+
+static std::string
+Trim (const std::string &s)
+{
+  std::string::size_type begin = s.find_first_not_of (" \t\r\n");
+  if (begin == std::string::npos)
+    {
+      return "";
+    }
+  std::string::size_type end = s.find_last_not_of (" \t\r\n");
+  return s.substr (begin, end - begin + 1);
+}
+
+static std::vector<SweepParameter>
+ReadGrid (const std::string &fileName)
+{
+  std::ifstream in (fileName.c_str ());
+  NS_ABORT_MSG_UNLESS (in, "Cannot open grid file " << fileName);
+
+  std::vector<SweepParameter> grid;
+  std::string line;
+  uint32_t lineNo = 0;
+  while (std::getline (in, line))
+    {
+      lineNo++;
+      line = Trim (line.substr (0, line.find ('#')));
+      if (line.empty ())
+        {
+          continue;
+        }
+      std::string::size_type eq = line.find ('=');
+      NS_ABORT_MSG_IF (eq == std::string::npos, fileName << ":" << lineNo << ": expected <parameter> = <values>");
+
+      SweepParameter param;
+      param.name = Trim (line.substr (0, eq));
+      std::istringstream values (line.substr (eq + 1));
+      std::string value;
+      while (std::getline (values, value, ','))
+        {
+          value = Trim (value);
+          if (!value.empty ())
+            {
+              param.values.push_back (value);
+            }
+        }
+      NS_ABORT_MSG_IF (param.name.empty () || param.values.empty (),
+                       fileName << ":" << lineNo << ": empty parameter name or value list");
+      NS_ABORT_MSG_IF (param.name == "metricsFormat",
+                       fileName << ":" << lineNo << ": the sweep only merges CSV output, metricsFormat cannot be swept");
+      // replications write <csv>-rep<i>.csv files, which the merge does not
+      // look for, and serve on ports that overlap those of the next points
+      NS_ABORT_MSG_IF (param.name == "replications",
+                       fileName << ":" << lineNo << ": every point is one run, replications cannot be swept");
+      grid.push_back (param);
+    }
+  return grid;
+}
+
+static std::vector<SweepPoint>
+ExpandGrid (const std::vector<SweepParameter> &grid, const std::string &outDir)
+{
+  std::vector<SweepPoint> points;
+  std::vector<uint32_t> odometer (grid.size (), 0);
+  bool done = false;
+  while (!done)
+    {
+      SweepPoint point;
+      point.index = points.size ();
+      point.status = -1;
+      for (uint32_t i = 0; i < grid.size (); i++)
+        {
+          point.values.push_back (grid[i].values[odometer[i]]);
+        }
+      std::ostringstream stem;
+      stem << outDir << "/point-" << point.index;
+      point.csvFileName = stem.str () + ".csv";
+      point.logFileName = stem.str () + ".log";
+      points.push_back (point);
+
+      // advance the last parameter fastest, so that the table comes out
+      // grouped by the first parameter of the grid file
+      done = true;
+      for (int i = grid.size () - 1; i >= 0; i--)
+        {
+          if (++odometer[i] < grid[i].values.size ())
+            {
+              done = false;
+              break;
+            }
+          odometer[i] = 0;
+        }
+    }
+  return points;
+}
+
+static pid_t
+StartPoint (const std::string &program, const std::vector<SweepParameter> &grid, const SweepPoint &point,
+            int metricsPort)
+{
+  std::vector<std::string> args;
+  args.push_back (program);
+  for (uint32_t i = 0; i < grid.size (); i++)
+    {
+      args.push_back ("--" + grid[i].name + "=" + point.values[i]);
+    }
+  args.push_back ("--CSVfileName=" + point.csvFileName);
+  if (metricsPort > 0)
+    {
+      std::ostringstream port;
+      port << "--metricsPort=" << metricsPort + point.index;
+      args.push_back (port.str ());
+    }
+
+  // build everything the child needs before forking, it may only make
+  // async-signal-safe calls until exec
+  std::vector<char *> argv;
+  for (uint32_t i = 0; i < args.size (); i++)
+    {
+      argv.push_back (const_cast<char *> (args[i].c_str ()));
+    }
+  argv.push_back (0);
+  int log = open (point.logFileName.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  NS_ABORT_MSG_IF (log < 0, "Cannot create " << point.logFileName << ": " << std::strerror (errno));
+
+  pid_t pid = fork ();
+  NS_ABORT_MSG_IF (pid < 0, "fork failed: " << std::strerror (errno));
+  if (pid == 0)
+    {
+      dup2 (log, STDOUT_FILENO);
+      dup2 (log, STDERR_FILENO);
+      close (log);
+      execv (argv[0], &argv[0]);
+      _exit (127);
+    }
+  close (log);
+  return pid;
+}
+
+/// \return the number of points that succeeded but left no CSV file to merge
+static uint32_t
+MergeResults (const std::vector<SweepParameter> &grid, const std::vector<SweepPoint> &points,
+              const std::string &output)
+{
+  uint32_t missing = 0;
+  std::ofstream out (output.c_str ());
+  NS_ABORT_MSG_UNLESS (out, "Cannot create " << output);
+
+  bool header = false;
+  for (uint32_t p = 0; p < points.size (); p++)
+    {
+      const SweepPoint &point = points[p];
+      if (point.status != 0)
+        {
+          continue;
+        }
+      std::ifstream in (point.csvFileName.c_str ());
+      std::string line;
+      if (!std::getline (in, line))
+        {
+          missing++;
+          std::cerr << "point " << point.index << " wrote no " << point.csvFileName
+                    << ", see " << point.logFileName << std::endl;
+          continue;
+        }
+      if (!header)
+        {
+          out << "Point";
+          for (uint32_t i = 0; i < grid.size (); i++)
+            {
+              out << "," << grid[i].name;
+            }
+          out << "," << line << std::endl;
+          header = true;
+        }
+
+      std::ostringstream prefix;
+      prefix << point.index;
+      for (uint32_t i = 0; i < grid.size (); i++)
+        {
+          prefix << "," << point.values[i];
+        }
+      std::string prefixStr = prefix.str ();
+      while (std::getline (in, line))
+        {
+          if (!line.empty ())
+            {
+              out << prefixStr << "," << line << "\n";
+            }
+        }
+    }
+  out.close ();
+  return missing;
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string gridFileName;
+  std::string program ("build/scratch/my-manet-routing-compare");
+  std::string outDir ("sweep");
+  std::string output;
+  uint32_t jobs = sysconf (_SC_NPROCESSORS_ONLN);
+  int metricsPort = 0;
+
+  CommandLine cmd;
+  cmd.AddValue ("grid", "Grid description file", gridFileName);
+  cmd.AddValue ("program", "Path to the scenario executable", program);
+  cmd.AddValue ("outDir", "Directory for the per-point CSV and log files", outDir);
+  cmd.AddValue ("output", "Merged CSV file (default <outDir>/sweep.csv)", output);
+  cmd.AddValue ("jobs", "Number of points run concurrently", jobs);
+  cmd.AddValue ("metricsPort", "Have point i serve its counters for Prometheus on this port + i (0 to disable)", metricsPort);
+  cmd.Parse (argc, argv);
+
+  NS_ABORT_MSG_IF (gridFileName.empty (), "--grid is required");
+  if (output.empty ())
+    {
+      output = outDir + "/sweep.csv";
+    }
+  if (jobs == 0)
+    {
+      jobs = 1;
+    }
+  NS_ABORT_MSG_IF (mkdir (outDir.c_str (), 0755) != 0 && errno != EEXIST,
+                   "Cannot create " << outDir << ": " << std::strerror (errno));
+
+  std::vector<SweepParameter> grid = ReadGrid (gridFileName);
+  std::vector<SweepPoint> points = ExpandGrid (grid, outDir);
+  std::cout << "Running " << points.size () << " points on " << jobs << " workers" << std::endl;
+
+  std::vector<std::pair<pid_t, uint32_t> > running;
+  uint32_t next = 0;
+  uint32_t failed = 0;
+  while (next < points.size () || !running.empty ())
+    {
+      while (next < points.size () && running.size () < jobs)
+        {
+          running.push_back (std::make_pair (StartPoint (program, grid, points[next], metricsPort), next));
+          next++;
+        }
+
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+        {
+          NS_ABORT_MSG_IF (errno != EINTR, "waitpid failed: " << std::strerror (errno));
+          continue;
+        }
+      for (uint32_t i = 0; i < running.size (); i++)
+        {
+          if (running[i].first != pid)
+            {
+              continue;
+            }
+          SweepPoint &point = points[running[i].second];
+          point.status = WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+          if (point.status != 0)
+            {
+              failed++;
+              std::cerr << "point " << point.index << " failed with status " << point.status
+                        << ", see " << point.logFileName << std::endl;
+            }
+          running.erase (running.begin () + i);
+          break;
+        }
+    }
+
+  failed += MergeResults (grid, points, output);
+  std::cout << points.size () - failed << "/" << points.size () << " points merged into " << output << std::endl;
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Offline converter for the binary outputs of my-manet-routing-compare.
+ * The input format is recognized from the file magic:
+ *
+ * - binary receive logs (--rxLog=binary) are rendered to the same lines
+ *   the scenario prints with --rxLog=text
+ * - binary PHY traces (--phyTrace=binary) are rendered to the lines of
+ *   the ns-3 ASCII trace, with a MAC header summary in place of the
+ *   full packet printout
+ * - node metrics files (--nodeMetrics) are rendered to CSV, one row per
+ *   interval and node
+ * - compressed metrics tables (--metricsFormat=gorilla) are rendered to
+ *   the CSV the scenario writes by default
+ *
+ *   ./waf --run "manet-trace-convert --input=AODV.rxlog --output=AODV.rx.txt"
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ns3/core-module.h"
+#include "manet-rx-log.h"
+#include "manet-phy-trace.h"
+#include "manet-node-metrics.h"
+#include "manet-metrics-writer.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ManetTraceConvert");
+
+static void
+ConvertRxLog (std::FILE *in, std::FILE *out)
+{
+  RxLogRecord records[4096];
+  char line[128];
+  size_t n;
+  while ((n = std::fread (records, sizeof (RxLogRecord), 4096, in)) > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+        {
+          int len = FormatRxLogRecord (records[i], line, sizeof (line));
+          std::fwrite (line, 1, len, out);
+          std::fputc ('\n', out);
+        }
+    }
+}
+
+static void
+ConvertPhyTrace (std::FILE *in, std::FILE *out)
+{
+  PhyTraceRecord records[4096];
+  PhyTraceFormatter formatter;
+  char line[512];
+  size_t n;
+  while ((n = std::fread (records, sizeof (PhyTraceRecord), 4096, in)) > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+        {
+          int len = formatter.Format (records[i], line, sizeof (line));
+          if (len > 0)
+            {
+              std::fwrite (line, 1, std::min<size_t> (len, sizeof (line) - 1), out);
+              std::fputc ('\n', out);
+            }
+        }
+    }
+}
+
+static void
+ConvertNodeMetrics (std::FILE *in, std::FILE *out, const std::string &input)
+{
+  // the magic has been read already
+  NodeMetricsHeader header;
+  NS_ABORT_MSG_IF (std::fread (reinterpret_cast<char *> (&header) + sizeof (header.magic),
+                               sizeof (header) - sizeof (header.magic), 1, in) != 1,
+                   input << " is too short");
+  NS_ABORT_MSG_IF (header.nMetrics != NODE_METRICS, input << " has " << header.nMetrics << " metrics, expected "
+                                                          << NODE_METRICS);
+  size_t column = size_t (header.nNodes) * header.nIntervals;
+  std::vector<uint64_t> data (column * header.nMetrics);
+  NS_ABORT_MSG_IF (std::fread (data.data (), sizeof (uint64_t), data.size (), in) != data.size (),
+                   input << " is truncated");
+
+  std::fprintf (out, "SimulationSecond,Node");
+  for (uint32_t m = 0; m < header.nMetrics; m++)
+    {
+      std::fprintf (out, ",%s", GetNodeMetricName (m));
+    }
+  std::fputc ('\n', out);
+  for (uint32_t t = 0; t < header.nIntervals; t++)
+    {
+      for (uint32_t node = 0; node < header.nNodes; node++)
+        {
+          std::fprintf (out, "%g,%u", (t + 1) * header.interval, node);
+          for (uint32_t m = 0; m < header.nMetrics; m++)
+            {
+              std::fprintf (out, ",%llu",
+                            (unsigned long long) data[m * column + size_t (node) * header.nIntervals + t]);
+            }
+          std::fputc ('\n', out);
+        }
+    }
+}
+
+static void
+ConvertMetrics (std::FILE *in, std::FILE *out, const std::string &input)
+{
+  MetricsReader reader (in);
+  std::string header;
+  NS_ABORT_MSG_IF (!reader.ReadHeader (header), input << " is too short");
+  std::fprintf (out, "%s\n", header.c_str ());
+  std::string line;
+  while (reader.ReadRow ())
+    {
+      line.clear ();
+      for (uint32_t i = 0; i < reader.GetNColumns (); i++)
+        {
+          if (i > 0)
+            {
+              line += ',';
+            }
+          reader.FormatColumn (i, line);
+        }
+      line += '\n';
+      std::fwrite (line.data (), 1, line.size (), out);
+    }
+  NS_ABORT_MSG_IF (reader.IsCorrupt (), input << " is truncated or corrupt");
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string input;
+  std::string output;
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Binary file written by the scenario", input);
+  cmd.AddValue ("output", "Text output file (default stdout)", output);
+  cmd.Parse (argc, argv);
+
+  NS_ABORT_MSG_IF (input.empty (), "--input is required");
+  std::FILE *in = std::fopen (input.c_str (), "rb");
+  NS_ABORT_MSG_IF (in == 0, "Cannot open " << input);
+  std::FILE *out = stdout;
+  if (!output.empty ())
+    {
+      out = std::fopen (output.c_str (), "w");
+      NS_ABORT_MSG_IF (out == 0, "Cannot create " << output);
+    }
+
+  char magic[8];
+  NS_ABORT_MSG_IF (std::fread (magic, sizeof (magic), 1, in) != 1, input << " is too short");
+  if (std::memcmp (magic, RX_LOG_MAGIC, sizeof (magic)) == 0)
+    {
+      ConvertRxLog (in, out);
+    }
+  else if (std::memcmp (magic, PHY_TRACE_MAGIC, sizeof (magic)) == 0)
+    {
+      ConvertPhyTrace (in, out);
+    }
+  else if (std::memcmp (magic, NODE_METRICS_MAGIC, sizeof (magic)) == 0)
+    {
+      ConvertNodeMetrics (in, out, input);
+    }
+  else if (std::memcmp (magic, METRICS_GORILLA_MAGIC, sizeof (magic)) == 0)
+    {
+      ConvertMetrics (in, out, input);
+    }
+  else
+    {
+      NS_ABORT_MSG (input << " is not a known binary trace format");
+    }
+
+  std::fclose (in);
+  if (out != stdout)
+    {
+      std::fclose (out);
+    }
+  return 0;
+}
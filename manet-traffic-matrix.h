@@ -0,0 +1,285 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_TRAFFIC_MATRIX_H
+#define MANET_TRAFFIC_MATRIX_H
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+#include "manet-traffic.h"
+
+namespace ns3 {
+
+/// One flow of a traffic matrix file.
+struct TrafficMatrixFlow
+{
+  uint32_t src;       ///< source node index
+  uint32_t dst;       ///< sink node index
+  double start;       ///< simulated seconds
+  double stop;
+  DataRate rate;
+  uint32_t size;      ///< packet size in bytes
+  bool tcp;
+  uint16_t port;
+};
+
+/**
+ * Traffic matrix read from a text file with one flow per line:
+ *
+ *   # src dst start stop rate size transport [port]
+ *   16 0 100.5 300 2048bps 512 tcp
+ *   17 0 101 250 64kbps 1024 udp 5000
+ *
+ * Fields are separated by blanks or commas; '#' starts a comment.  Nodes
+ * are indices into the scenario's node list, times are in simulated
+ * seconds, the rate takes any DataRate unit, the transport is tcp or
+ * udp and the port defaults to the one of the scenario.
+ *
+ * Install () gives each source node one TrafficGenerator carrying all of
+ * its flows, and each (sink node, port, transport) one PacketSink shared
+ * by all the flows that end there.  Flow i of the file is flow id i of
+ * the Tx trace of the generators.
+ */
+class TrafficMatrix
+{
+public:
+  /**
+   * \param fileName the matrix file
+   * \param defaultPort the port of the lines that give none
+   * \param error set to the reason of a failure
+   * \return false if the file cannot be read or is malformed
+   */
+  bool Load (std::string fileName, uint16_t defaultPort, std::string &error)
+  {
+    std::FILE *in = std::fopen (fileName.c_str (), "r");
+    if (in == 0)
+      {
+        error = "Cannot open " + fileName + ": " + std::strerror (errno);
+        return false;
+      }
+    m_flows.clear ();
+    std::map<std::string, DataRate> rates;
+    char line[1024];
+    uint32_t lineNumber = 0;
+    bool ok = true;
+    while (ok && std::fgets (line, sizeof (line), in) != 0)
+      {
+        lineNumber++;
+        char *comment = std::strchr (line, '#');
+        if (comment != 0)
+          {
+            *comment = '\0';
+          }
+        char *fields[8];
+        uint32_t nFields = 0;
+        char *save;
+        for (char *field = strtok_r (line, " \t,\r\n", &save); field != 0 && nFields < 9;
+             field = strtok_r (0, " \t,\r\n", &save))
+          {
+            if (nFields < 8)
+              {
+                fields[nFields] = field;
+              }
+            nFields++;
+          }
+        if (nFields == 0)
+          {
+            continue;
+          }
+        TrafficMatrixFlow flow;
+        ok = (nFields == 7 || nFields == 8)
+          && ParseUint (fields[0], flow.src)
+          && ParseUint (fields[1], flow.dst)
+          && ParseDouble (fields[2], flow.start)
+          && ParseDouble (fields[3], flow.stop)
+          && ParseUint (fields[5], flow.size)
+          && flow.size > 0
+          && flow.start < flow.stop
+          && (std::strcmp (fields[6], "tcp") == 0 || std::strcmp (fields[6], "udp") == 0);
+        uint32_t port = defaultPort;
+        ok = ok && (nFields == 7 || (ParseUint (fields[7], port) && port > 0 && port < 65536));
+        if (ok)
+          {
+            std::map<std::string, DataRate>::iterator rate = rates.find (fields[4]);
+            if (rate == rates.end ())
+              {
+                // parse each distinct rate once
+                DataRateValue value;
+                ok = value.DeserializeFromString (fields[4], MakeDataRateChecker ());
+                rate = rates.insert (std::make_pair (std::string (fields[4]), value.Get ())).first;
+              }
+            flow.rate = rate->second;
+            flow.tcp = fields[6][1] == 'c';
+            flow.port = port;
+            ok = ok && flow.rate.GetBitRate () > 0;
+          }
+        if (ok)
+          {
+            m_flows.push_back (flow);
+          }
+      }
+    std::fclose (in);
+    if (!ok)
+      {
+        std::ostringstream os;
+        os << fileName << ":" << lineNumber
+           << ": expected src dst start stop rate size tcp|udp [port]";
+        error = os.str ();
+      }
+    return ok;
+  }
+
+  uint32_t GetNFlows (void) const
+  {
+    return m_flows.size ();
+  }
+
+  const TrafficMatrixFlow &GetFlow (uint32_t i) const
+  {
+    return m_flows[i];
+  }
+
+  /// \return the PacketSinks installed, one per node, port and transport
+  ApplicationContainer GetSinks (void) const
+  {
+    return m_sinks;
+  }
+
+  /// \return the TrafficGenerators installed, one per source node
+  ApplicationContainer GetSources (void) const
+  {
+    return m_sources;
+  }
+
+  /**
+   * Install the flows.
+   *
+   * \param nodes the nodes the indices of the file refer to
+   * \param interfaces their IPv4 interfaces, in the same order
+   * \param pattern the spacing of the packets of every flow
+   * \param offset the current simulated time, which the application start
+   *        and stop times are relative to
+   * \param stop when the sinks stop
+   * \param error set to the reason of a failure
+   * \return false if a flow refers to a node that does not exist
+   */
+  bool Install (NodeContainer nodes, Ipv4InterfaceContainer interfaces, TrafficGenerator::Pattern pattern,
+                Time offset, Time stop, std::string &error)
+  {
+    std::vector<Ptr<TrafficGenerator> > generators (nodes.GetN ());
+    std::map<SinkKey, Ptr<Application> > sinks;
+    TypeId udp = UdpSocketFactory::GetTypeId ();
+    TypeId tcp = TcpSocketFactory::GetTypeId ();
+    for (uint32_t i = 0; i < m_flows.size (); i++)
+      {
+        const TrafficMatrixFlow &flow = m_flows[i];
+        if (flow.src >= nodes.GetN () || flow.dst >= nodes.GetN () || flow.src == flow.dst)
+          {
+            std::ostringstream os;
+            os << "Flow " << i << " goes from node " << flow.src << " to node " << flow.dst
+               << ", of " << nodes.GetN ();
+            error = os.str ();
+            return false;
+          }
+
+        Ptr<Application> &sink = sinks[SinkKey (flow.dst, flow.port, flow.tcp)];
+        if (sink == 0)
+          {
+            PacketSinkHelper sinkHelper (flow.tcp ? "ns3::TcpSocketFactory" : "ns3::UdpSocketFactory",
+                                         InetSocketAddress (Ipv4Address::GetAny (), flow.port));
+            sink = sinkHelper.Install (nodes.Get (flow.dst)).Get (0);
+            sink->SetStartTime (Seconds (0));
+            sink->SetStopTime (stop - offset);
+            m_sinks.Add (sink);
+          }
+
+        Ptr<TrafficGenerator> &generator = generators[flow.src];
+        if (generator == 0)
+          {
+            generator = CreateObject<TrafficGenerator> ();
+            generator->SetAttribute ("Pattern", EnumValue (pattern));
+            nodes.Get (flow.src)->AddApplication (generator);
+            // the flows start and stop on their own
+            generator->SetStartTime (Seconds (0));
+            m_sources.Add (generator);
+          }
+        generator->AddFlow (InetSocketAddress (interfaces.GetAddress (flow.dst), flow.port), flow.rate,
+                            flow.size, Seconds (flow.start), Seconds (flow.stop), i, flow.tcp ? tcp : udp);
+      }
+    return true;
+  }
+
+private:
+  /// (node, port, tcp)
+  struct SinkKey
+  {
+    SinkKey (uint32_t node, uint16_t port, bool tcp)
+      : node (node),
+        port (port),
+        tcp (tcp)
+    {
+    }
+    bool operator < (const SinkKey &other) const
+    {
+      if (node != other.node)
+        {
+          return node < other.node;
+        }
+      if (port != other.port)
+        {
+          return port < other.port;
+        }
+      return tcp < other.tcp;
+    }
+    uint32_t node;
+    uint16_t port;
+    bool tcp;
+  };
+
+  static bool ParseUint (const char *s, uint32_t &value)
+  {
+    char *end;
+    errno = 0;
+    unsigned long v = std::strtoul (s, &end, 10);
+    value = v;
+    return *s >= '0' && *s <= '9' && *end == '\0' && errno == 0 && v <= 0xffffffffUL;
+  }
+
+  static bool ParseDouble (const char *s, double &value)
+  {
+    char *end;
+    value = std::strtod (s, &end);
+    return *s != '\0' && *end == '\0' && value >= 0;
+  }
+
+  std::vector<TrafficMatrixFlow> m_flows;
+  ApplicationContainer m_sinks;
+  ApplicationContainer m_sources;
+};
+
+} // namespace ns3
+
+#endif /* MANET_TRAFFIC_MATRIX_H */
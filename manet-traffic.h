@@ -0,0 +1,291 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MANET_TRAFFIC_H
+#define MANET_TRAFFIC_H
+
+#include <functional>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+namespace ns3 {
+
+/**
+ * Constant bit rate or Poisson traffic source for any number of flows of
+ * one node, in place of one OnOffApplication per flow.
+ *
+ * Each flow has its own socket, opened when it starts, and its own
+ * protocol, rate, packet size and start and stop times.  The
+ * flows of a node share a single pending send event: the next send time
+ * of every flow is kept in a heap, and the event runs the earliest one.
+ * Send intervals are precomputed: constant per flow for CBR, and for
+ * Poisson drawn in batches of exponential variates of mean 1 that each
+ * flow scales by its mean interval.  Packets are copies of one template
+ * per packet size, which share its zero-filled buffer, instead of fresh
+ * allocations.
+ *
+ * A packet the socket does not accept, e.g. because the TCP send buffer
+ * is full, is dropped and counted, not queued.
+ */
+class TrafficGenerator : public Application
+{
+public:
+  enum Pattern
+  {
+    CBR,
+    POISSON
+  };
+
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::TrafficGenerator")
+      .SetParent<Application> ()
+      .SetGroupName ("Applications")
+      .AddConstructor<TrafficGenerator> ()
+      .AddAttribute ("Protocol",
+                     "The socket factory of the flows added without one, e.g. ns3::UdpSocketFactory.",
+                     TypeIdValue (UdpSocketFactory::GetTypeId ()),
+                     MakeTypeIdAccessor (&TrafficGenerator::m_tid),
+                     MakeTypeIdChecker ())
+      .AddAttribute ("Pattern",
+                     "Spacing of the packets of each flow.",
+                     EnumValue (CBR),
+                     MakeEnumAccessor (&TrafficGenerator::m_pattern),
+                     MakeEnumChecker (CBR, "Cbr",
+                                      POISSON, "Poisson"))
+      .AddTraceSource ("Tx",
+                       "A packet is sent, with the id given to its flow by AddFlow.",
+                       MakeTraceSourceAccessor (&TrafficGenerator::m_txTrace),
+                       "ns3::TrafficGenerator::TxTracedCallback")
+    ;
+    return tid;
+  }
+
+  typedef void (*TxTracedCallback)(uint32_t flow, Ptr<const Packet> packet);
+
+  TrafficGenerator ()
+    : m_pattern (CBR),
+      m_nextGap (0),
+      m_dropped (0)
+  {
+    m_gapVariable = CreateObject<ExponentialRandomVariable> ();
+  }
+
+  /**
+   * \param remote the address of the sink
+   * \param rate the mean data rate of the flow
+   * \param size the packet size in bytes
+   * \param start when the flow starts sending, no sooner than the
+   *              application starts
+   * \param stop when the flow stops sending, no later than the
+   *             application stops
+   * \param id the flow id passed to the Tx trace
+   * \param protocol the socket factory, the Protocol attribute if unset
+   */
+  void AddFlow (Address remote, DataRate rate, uint32_t size, Time start, Time stop, uint32_t id,
+                TypeId protocol = TypeId ())
+  {
+    NS_ASSERT (size > 0 && rate.GetBitRate () > 0);
+    Flow flow;
+    flow.remote = remote;
+    flow.protocol = protocol;
+    flow.interval = Seconds (size * 8 / static_cast<double> (rate.GetBitRate ()));
+    flow.start = start;
+    flow.stop = stop;
+    flow.id = id;
+    Ptr<Packet> &packet = m_templates[size];
+    if (packet == 0)
+      {
+        packet = Create<Packet> (size);
+      }
+    flow.packet = packet;
+    m_flows.push_back (flow);
+  }
+
+  uint32_t GetNFlows (void) const
+  {
+    return m_flows.size ();
+  }
+
+  /// \return the packets the sockets did not accept
+  uint64_t GetDropped (void) const
+  {
+    return m_dropped;
+  }
+
+  int64_t AssignStreams (int64_t stream)
+  {
+    m_gapVariable->SetStream (stream);
+    return 1;
+  }
+
+protected:
+  virtual void DoDispose (void)
+  {
+    m_flows.clear ();
+    m_templates.clear ();
+    Application::DoDispose ();
+  }
+
+private:
+  struct Flow
+  {
+    Address remote;
+    TypeId protocol;
+    Time interval;    ///< mean time between two packets
+    Time start;
+    Time stop;
+    uint32_t id;
+    Ptr<Packet> packet;
+    Ptr<Socket> socket;
+  };
+
+  /// (next send time, flow index), earliest first
+  typedef std::pair<Time, uint32_t> Send;
+  typedef std::priority_queue<Send, std::vector<Send>, std::greater<Send> > SendQueue;
+
+  enum
+  {
+    GAP_BATCH = 256
+  };
+
+  virtual void StartApplication (void)
+  {
+    Time now = Simulator::Now ();
+    for (uint32_t i = 0; i < m_flows.size (); i++)
+      {
+        Time start = std::max (m_flows[i].start, now);
+        if (start < m_flows[i].stop)
+          {
+            m_sends.push (Send (start, i));
+          }
+      }
+    ScheduleNext ();
+  }
+
+  virtual void StopApplication (void)
+  {
+    Simulator::Cancel (m_sendEvent);
+    m_sends = SendQueue ();
+    for (std::vector<Flow>::iterator i = m_flows.begin (); i != m_flows.end (); ++i)
+      {
+        if (i->socket != 0)
+          {
+            i->socket->Close ();
+            i->socket = 0;
+          }
+      }
+  }
+
+  void Open (Flow &flow)
+  {
+    flow.socket = Socket::CreateSocket (GetNode (), flow.protocol == TypeId () ? m_tid : flow.protocol);
+    if (Inet6SocketAddress::IsMatchingType (flow.remote))
+      {
+        flow.socket->Bind6 ();
+      }
+    else
+      {
+        flow.socket->Bind ();
+      }
+    flow.socket->Connect (flow.remote);
+    flow.socket->SetAllowBroadcast (true);
+    flow.socket->ShutdownRecv ();
+  }
+
+  void ScheduleNext (void)
+  {
+    if (!m_sends.empty ())
+      {
+        m_sendEvent = Simulator::Schedule (m_sends.top ().first - Simulator::Now (),
+                                           &TrafficGenerator::SendDue, this);
+      }
+  }
+
+  /// Send the packets of every flow due now.
+  void SendDue (void)
+  {
+    Time now = Simulator::Now ();
+    while (!m_sends.empty () && m_sends.top ().first <= now)
+      {
+        uint32_t i = m_sends.top ().second;
+        m_sends.pop ();
+        Flow &flow = m_flows[i];
+        if (flow.socket == 0)
+          {
+            Open (flow);
+          }
+        Ptr<Packet> packet = flow.packet->Copy ();
+        m_txTrace (flow.id, packet);
+        if (flow.socket->Send (packet) < 0)
+          {
+            m_dropped++;
+          }
+        Time next = now + GetGap (flow);
+        if (next < flow.stop)
+          {
+            m_sends.push (Send (next, i));
+          }
+        else
+          {
+            flow.socket->Close ();
+            flow.socket = 0;
+          }
+      }
+    ScheduleNext ();
+  }
+
+  Time GetGap (const Flow &flow)
+  {
+    if (m_pattern == CBR)
+      {
+        return flow.interval;
+      }
+    if (m_nextGap == m_gaps.size ())
+      {
+        m_gaps.resize (GAP_BATCH);
+        for (uint32_t i = 0; i < GAP_BATCH; i++)
+          {
+            m_gaps[i] = m_gapVariable->GetValue (1.0, 0);
+          }
+        m_nextGap = 0;
+      }
+    return Seconds (flow.interval.GetSeconds () * m_gaps[m_nextGap++]);
+  }
+
+  TypeId m_tid;
+  Pattern m_pattern;
+  std::vector<Flow> m_flows;
+  std::map<uint32_t, Ptr<Packet> > m_templates;   ///< one packet per size
+  SendQueue m_sends;
+  EventId m_sendEvent;
+  Ptr<ExponentialRandomVariable> m_gapVariable;
+  std::vector<double> m_gaps;
+  uint32_t m_nextGap;
+  uint64_t m_dropped;
+  TracedCallback<uint32_t, Ptr<const Packet> > m_txTrace;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (TrafficGenerator);
+
+} // namespace ns3
+
+#endif /* MANET_TRAFFIC_H */
@@ -44,29 +44,101 @@
  * directly modifying the speed and the number of nodes.  It is also
  * possible to change the characteristics of the network by changing
  * the transmit power (as power increases, the impact of mobility
- * decreases and the effective density increases).
+ * decreases and the effective density increases).  All of these are
+ * available as command line arguments (--nWifis, --nodeSpeed, --txp, ...),
+ * and manet-sweep runs a whole grid of them in parallel.  For large
+ * node counts, --channel=grid only delivers each frame to the receivers
+ * that can detect it (see manet-grid-wifi-channel.h), and --lossCache
+ * computes the path loss between stationary nodes only once.
  *
- * By default, OLSR is used, but specifying a value of 2 for the protocol
- * will cause AODV to be used, and specifying a value of 3 will cause
- * DSDV to be used.
+ * By default, AODV is used; --protocol selects OLSR (1), AODV (2),
+ * DSDV (3) or DSR (4), by number or by name (see
+ * manet-routing-registry.h).  Trace files and the RoutingProtocol column
+ * of the csv file are labelled with the protocol name.
  *
  * By default, there are 10 source/sink data pairs sending UDP data
  * at an application rate of 2.048 Kb/s each.    This is typically done
  * at a rate of 4 64-byte packets per second.  Application data is
  * started at a random time between 50 and 51 seconds and continues
- * to the end of the simulation.
+ * to the end of the simulation.  --traffic=cbr or poisson sends the same
+ * rate with the pooled TrafficGenerator of manet-traffic.h, one per
+ * source node, instead of an OnOffApplication per flow.
+ * --trafficMatrix replaces these pairs with the flows of a file (see
+ * manet-traffic-matrix.h), sent by the same generators, with one sink
+ * per node, port and transport.  The setup time and memory per flow are
+ * printed.
+ *
+ * --scheduler selects the event scheduler, including the ladder queue of
+ * manet-ladder-scheduler.h; --schedulerLog records the event stream for
+ * manet-scheduler-bench to replay under each scheduler.  --profile
+ * breaks the wall-clock time of the run down by event type (see
+ * manet-profiling-scheduler.h); without it, no event is timed.
+ * --progress=N prints the simulated time, events per second and an
+ * estimate of the time left on stderr every N wall-clock seconds (see
+ * manet-progress-scheduler.h).  These options wrap the scheduler in
+ * turn, so they can be combined.
+ *
+ * --memoryStats writes <csv name>-memory.csv with the resident set size,
+ * heap in use, packets created and queued in the MACs, and events pending
+ * every second (see manet-memory-stats.h); it takes a packet uid per
+ * sample, so it cannot be combined with the traces of --tracing=full.
+ * --nodeMetrics keeps the IPv4 bytes received and sent, drops, routing
+ * control bytes and MAC queue depth of every node and second in memory,
+ * and writes them once at the end to <csv name>-nodes.bin (see
+ * manet-node-metrics.h).
+ * --liveMetrics=FILE publishes the simulated time, event rate, receive
+ * and drop counts, routing overhead and per-flow goodput every second in
+ * FILE, mapped in shared memory, where manet-live-monitor or any other
+ * local process can read them while the run goes on (see
+ * manet-live-metrics.h).  --metricsPort=N serves the same counters in
+ * the Prometheus text format on http://127.0.0.1:N/metrics, from a thread
+ * of its own, for dashboards comparing concurrent runs (see
+ * manet-metrics-exporter.h); replications use ports N + i.
+ *
+ * With --replications=N, the part of the run before the applications
+ * start is simulated once and the process then forks N replications of
+ * the rest, each with its own run number for the application randomness
+ * and its own output files (<csv name>-rep<i>.csv, ...).  Their tables
+ * start at the fork.
  *
  * The program outputs a few items:
- * - packet receptions are notified to stdout such as:
+ * - with --rxLog=text, packet receptions are notified to stdout such as:
  *   <timestamp> <node-id> received one packet from <src-address>
+ *   (--rxLog=binary logs them to a binary file instead; the default,
+ *   --rxLog=none, leaves the sinks' Rx trace unconnected)
  * - each second, the data reception statistics are tabulated and output
- *   to a comma-separated value (csv) file
- * - some tracing and flow monitor configuration that used to work is
- *   left commented inline in the program
+ *   to a comma-separated value (csv) file, together with the routing
+ *   control packets and bytes sent in that second; a companion
+ *   <csv name>-overhead.csv breaks the control traffic down per node and
+ *   message type (see manet-routing-overhead.h); the end-to-end delay
+ *   percentiles of the application packets received in that second are
+ *   added as well, and <csv name>-latency.csv gives them per flow (see
+ *   manet-latency.h); the receive rate counts the bytes the sink
+ *   applications get, and <csv name>-goodput.csv gives it per flow (see
+ *   manet-goodput.h); --metricsFormat=gorilla writes these tables as
+ *   compressed time series (.mts in place of .csv, see
+ *   manet-metrics-writer.h), which manet-trace-convert turns back into CSV
+ * - --tracing=flow adds <csv name>-flowmon.csv, the per-flow FlowMonitor
+ *   counters of every --flowInterval seconds (see manet-flow-export.h),
+ *   and --tracing=full adds the FlowMonitor XML file and
+ *   ASCII (or, with --phyTrace=binary, binary) PHY, pcap, mobility and
+ *   NetAnim traces (and full packet metadata for the ASCII trace);
+ *   --traceCompression=gzip or zstd compresses the ASCII and pcap traces
+ *   while they are written
  */
 
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
@@ -82,6 +154,28 @@
 #include "ns3/animation-interface.h"
 #include "ns3/netanim-module.h"
 #include "ns3/trace-helper.h"
+#include "manet-metrics-writer.h"
+#include "manet-rx-log.h"
+#include "manet-compressed-trace.h"
+#include "manet-phy-trace.h"
+#include "manet-mobility-replay.h"
+#include "manet-grid-wifi-channel.h"
+#include "manet-loss-cache.h"
+#include "manet-routing-registry.h"
+#include "manet-routing-overhead.h"
+#include "manet-flow-export.h"
+#include "manet-latency.h"
+#include "manet-ladder-scheduler.h"
+#include "manet-scheduler-decorator.h"
+#include "manet-profiling-scheduler.h"
+#include "manet-progress-scheduler.h"
+#include "manet-memory-stats.h"
+#include "manet-traffic.h"
+#include "manet-traffic-matrix.h"
+#include "manet-goodput.h"
+#include "manet-node-metrics.h"
+#include "manet-live-metrics.h"
+#include "manet-metrics-exporter.h"
 
 using namespace ns3;
 using namespace dsr;
@@ -92,26 +186,103 @@ class RoutingExperiment
 {
 public:
   RoutingExperiment ();
-  void Run (int nSinks, double txp, std::string CSVfileName);
+  void Run ();
   //static void SetMACParam (ns3::NetDeviceContainer & devices,
   //                                 int slotDistance);
   std::string CommandSetup (int argc, char **argv);
 
 private:
+  /// how LogReceive reports each received packet
+  enum RxLogMode
+  {
+    RX_LOG_NONE,
+    RX_LOG_TEXT,   ///< one NS_LOG_UNCOND line per packet
+    RX_LOG_BINARY  ///< fixed-size records drained to disk by RxLogWriter
+  };
+
+  /// output profiles, each one includes everything the previous one writes
+  enum TracingProfile
+  {
+    TRACING_NONE,
+    TRACING_METRICS, ///< the per-second CSV table
+    TRACING_FLOW,    ///< plus FlowMonitor
+    TRACING_FULL     ///< plus packet metadata, ASCII, pcap, mobility and NetAnim traces
+  };
+
   Ptr<Socket> SetupPacketReceive (Ipv4Address addr, Ptr<Node> node);
   void ReceivePacket (Ptr<Socket> socket);
+  void LogReceive (uint32_t node, Ptr<const Packet> packet, const Address &senderAddress);
+  static void SinkRx (RoutingExperiment *self, uint32_t node, Ptr<const Packet> packet, const Address &from);
   void CheckThroughput ();
+  std::string CompanionFileName (std::string suffix) const;
+  void OpenMetrics (MetricsWriter &writer, std::string fileName, const std::string &header);
+  bool ForkReplications ();
+  void RunScenario ();
+  void SetupTrafficMatrix (NodeContainer nodes, Ipv4InterfaceContainer interfaces, Time start,
+                           ApplicationContainer &sinks);
 
   uint32_t port;
   uint32_t bytesTotal;
   uint32_t packetsReceived;
 
   std::string m_CSVfileName;
+  MetricsWriter m_metrics;
+  RoutingOverhead m_overhead;
+  MetricsWriter m_overheadMetrics;
+  FlowExporter m_flowExporter;
+  MetricsWriter m_flowMetrics;
+  double m_flowInterval;
+  LatencyRecorder m_latency;
+  MetricsWriter m_latencyMetrics;
+  GoodputRecorder m_goodput;
+  MetricsWriter m_goodputMetrics;
+  bool m_memoryStats;
+  MemoryStats m_memory;
+  MetricsWriter m_memoryMetrics;
+  bool m_nodeMetrics;
+  NodeMetricsTracer m_nodeTracer;
+  std::string m_liveMetricsFile;
+  LiveMetrics m_liveMetrics;
+  int m_metricsPort;
+  MetricsExporter m_exporter;
+  uint32_t m_metricsFlushBytes;
+  double m_metricsFlushInterval;
+  MetricsFormat m_metricsFormat;
   int m_nSinks;
   std::string m_protocolName;
   double m_txp;
   bool m_traceMobility;
   uint32_t m_protocol;
+  TracingProfile m_tracing;
+  TraceCompressor m_traceCompressor;
+  bool m_binaryPhyTrace;
+  PhyBinaryTrace m_phyTrace;
+  RxLogMode m_rxLogMode;
+  uint32_t m_rxLogCapacity;
+  RxLogWriter m_rxLog;
+
+  // scenario parameters, overridable from the command line so that a
+  // sweep (see manet-sweep.cc) can run every grid point without a rebuild
+  int m_nWifis;
+  std::string m_mobilityReplay;
+  bool m_gridChannel;
+  bool m_lossCache;
+  int m_nodeSpeed;
+  int m_nodePause;
+  std::string m_rate;
+  std::string m_traffic;
+  std::string m_trafficMatrix;
+  double m_totalTime;
+
+  std::string m_scheduler;
+  std::string m_schedulerLog;
+  bool m_profile;
+  double m_progress;
+
+  // shared warmup (see ForkReplications)
+  uint32_t m_replications;
+  double m_forkWarmup;
+  int m_replication;
 };
 
 RoutingExperiment::RoutingExperiment ()
@@ -120,17 +291,45 @@ RoutingExperiment::RoutingExperiment ()
     packetsReceived (0),
     // change to AODV-simulation.csv
     m_CSVfileName ("AODV-simulation.csv"),
+    m_flowInterval (1.0),
+    m_memoryStats (false),
+    m_nodeMetrics (false),
+    m_metricsPort (-1),
+    m_metricsFlushBytes (64 * 1024),
+    m_metricsFlushInterval (10.0),
+    m_metricsFormat (METRICS_CSV),
+    // half of the nodes
+    m_nSinks (15),
+    m_txp (7.5),
     m_traceMobility (true), // change to true for tracing
-    m_protocol (2) // AODV
-
+    m_protocol (2), // AODV
+    m_tracing (TRACING_METRICS),
+    m_binaryPhyTrace (false),
+    m_rxLogMode (RX_LOG_NONE),
+    m_rxLogCapacity (64 * 1024),
+    // might be the nodes
+    m_nWifis (15),
+    m_gridChannel (false),
+    m_lossCache (false),
+    m_nodeSpeed (20), //in m/s
+    m_nodePause (0), //in s
+    m_rate ("2048bps"),
+    m_traffic ("onoff"),
+    // simulation time: 300 dapat CHANGE LATER!
+    m_totalTime (300.0),
+    m_profile (false),
+    m_progress (0),
+    m_replications (0),
+    m_forkWarmup (100.0),
+    m_replication (-1)
 {
 }
 static inline std::string
-PrintReceivedPacket (Ptr<Socket> socket, Ptr<Packet> packet, Address senderAddress)
+PrintReceivedPacket (uint32_t node, Address senderAddress)
 {
   std::ostringstream oss;
 
-  oss << Simulator::Now ().GetSeconds () << " " << socket->GetNode ()->GetId ();
+  oss << Simulator::Now ().GetSeconds () << " " << node;
 
   if (InetSocketAddress::IsMatchingType (senderAddress))
     {
@@ -153,31 +352,253 @@ RoutingExperiment::ReceivePacket (Ptr<Socket> socket)
     {
       bytesTotal += packet->GetSize ();
       packetsReceived += 1;
-      NS_LOG_UNCOND (PrintReceivedPacket (socket, packet, senderAddress));
+      LogReceive (socket->GetNode ()->GetId (), packet, senderAddress);
+    }
+}
+
+/// Report a packet received by node to the --rxLog output.
+void
+RoutingExperiment::LogReceive (uint32_t node, Ptr<const Packet> packet, const Address &senderAddress)
+{
+  switch (m_rxLogMode)
+    {
+    case RX_LOG_TEXT:
+      NS_LOG_UNCOND (PrintReceivedPacket (node, senderAddress));
+      break;
+    case RX_LOG_BINARY:
+      {
+        RxLogRecord record;
+        record.timeNs = Simulator::Now ().GetNanoSeconds ();
+        record.node = node;
+        record.from = 0;
+        record.size = packet->GetSize ();
+        record.flags = 0;
+        if (InetSocketAddress::IsMatchingType (senderAddress))
+          {
+            record.from = InetSocketAddress::ConvertFrom (senderAddress).GetIpv4 ().Get ();
+            record.flags = RX_LOG_FROM_INET;
+          }
+        m_rxLog.Log (record);
+      }
+      break;
+    case RX_LOG_NONE:
+      break;
     }
 }
 
+/// Bound to the Rx trace of the sink applications.
+void
+RoutingExperiment::SinkRx (RoutingExperiment *self, uint32_t node, Ptr<const Packet> packet, const Address &from)
+{
+  self->LogReceive (node, packet, from);
+}
+
 void
 RoutingExperiment::CheckThroughput ()
 {
+  // the sink applications, plus any socket of SetupPacketReceive
+  bytesTotal += m_goodput.GetBytes ();
+  packetsReceived += m_goodput.GetPackets ();
+  m_liveMetrics.AddReceived (packetsReceived, bytesTotal);
   double kbs = (bytesTotal * 8.0) / 1000;
   bytesTotal = 0;
 
-  std::ofstream out (m_CSVfileName.c_str (), std::ios::app);
-
-  out << (Simulator::Now ()).GetSeconds () << ","
-      << kbs << ","
-      << packetsReceived << ","
-      << m_nSinks << ","
-      << m_protocolName << ","
-      << m_txp << ""
-      << std::endl;
+  double now = Simulator::Now ().GetSeconds ();
+  m_metrics.AddDouble (now)
+    .AddDouble (kbs)
+    .AddUint (packetsReceived)
+    .AddInt (m_nSinks)
+    .AddString (m_protocolName)
+    .AddDouble (m_txp)
+    .AddUint (m_overhead.GetPackets ())
+    .AddUint (m_overhead.GetBytes ());
+  const LatencyHistogram &latency = m_latency.GetAggregate ();
+  m_metrics.AddDouble (latency.GetPercentile (50) / 1e9)
+    .AddDouble (latency.GetPercentile (95) / 1e9)
+    .AddDouble (latency.GetPercentile (99) / 1e9)
+    .AddDouble (latency.GetMax () / 1e9);
+  m_metrics.EndRow (now);
+  if (m_nodeMetrics)
+    {
+      // before the overhead counters are reset
+      m_nodeTracer.EndInterval (now, m_overhead);
+    }
+  if (!m_liveMetricsFile.empty () || m_exporter.IsStarted ())
+    {
+      m_liveMetrics.AddControl (m_overhead.GetPackets (), m_overhead.GetBytes ());
+      for (uint32_t i = 0; i < m_goodput.GetNFlows (); i++)
+        {
+          m_liveMetrics.AddFlowBytes (i, m_goodput.GetFlowBytes (i));
+        }
+      m_liveMetrics.Publish (now, 1.0);
+      if (m_exporter.IsStarted ())
+        {
+          m_exporter.Publish (m_liveMetrics.GetValues ());
+        }
+    }
+  m_overhead.EndInterval (m_overheadMetrics, now);
+  m_latency.EndInterval (m_latencyMetrics, now);
+  m_goodput.EndInterval (m_goodputMetrics, now, 1.0);
+  if (m_memoryMetrics.IsOpen ())
+    {
+      m_memory.Sample (m_memoryMetrics, now);
+    }
 
-  out.close ();
   packetsReceived = 0;
   Simulator::Schedule (Seconds (1.0), &RoutingExperiment::CheckThroughput, this);
 }
 
+/**
+ * Run the warmup (everything before the applications start) once, then
+ * fork m_replications children, at most one per core at a time.  Each
+ * child gets its own run number, RngRun + its index, for the random
+ * variables created from then on (the applications and their traffic),
+ * while the warmed up routing, MAC and mobility state is shared
+ * copy-on-write.
+ *
+ * \return true in the children, which go on with the rest of the run,
+ *         false in the parent once all of them have exited
+ */
+bool
+RoutingExperiment::ForkReplications ()
+{
+  Simulator::Stop (Seconds (m_forkWarmup));
+  Simulator::Run ();
+  // do not let the children write the parent's buffered output again
+  std::cout.flush ();
+  std::fflush (0);
+
+  uint64_t baseRun = RngSeedManager::GetRun ();
+  uint32_t jobs = sysconf (_SC_NPROCESSORS_ONLN);
+  if (jobs == 0)
+    {
+      jobs = 1;
+    }
+  uint32_t running = 0;
+  uint32_t next = 0;
+  uint32_t failed = 0;
+  while (next < m_replications || running > 0)
+    {
+      while (next < m_replications && running < jobs)
+        {
+          pid_t pid = fork ();
+          NS_ABORT_MSG_IF (pid < 0, "fork failed: " << std::strerror (errno));
+          if (pid == 0)
+            {
+              m_replication = next;
+              RngSeedManager::SetRun (baseRun + next);
+              return true;
+            }
+          running++;
+          next++;
+        }
+
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+        {
+          NS_ABORT_MSG_IF (errno != EINTR, "waitpid failed: " << std::strerror (errno));
+          continue;
+        }
+      running--;
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          failed++;
+        }
+    }
+  NS_ABORT_MSG_IF (failed > 0, failed << " of " << m_replications << " replications failed");
+  return false;
+}
+
+/// \return m_CSVfileName with its .csv extension replaced by suffix
+std::string
+RoutingExperiment::CompanionFileName (std::string suffix) const
+{
+  std::string base = m_CSVfileName;
+  if (base.size () > 4 && base.compare (base.size () - 4, 4, ".csv") == 0)
+    {
+      base.erase (base.size () - 4);
+    }
+  return base + suffix;
+}
+
+/**
+ * Open writer on fileName, as CSV or, with --metricsFormat=gorilla,
+ * compressed with the .csv extension replaced by .mts, and close it
+ * when the simulator is destroyed.
+ */
+void
+RoutingExperiment::OpenMetrics (MetricsWriter &writer, std::string fileName, const std::string &header)
+{
+  if (m_metricsFormat == METRICS_GORILLA
+      && fileName.size () > 4 && fileName.compare (fileName.size () - 4, 4, ".csv") == 0)
+    {
+      fileName.replace (fileName.size () - 4, 4, ".mts");
+    }
+  writer.SetFlushPolicy (m_metricsFlushBytes, m_metricsFlushInterval);
+  writer.SetFormat (m_metricsFormat);
+  NS_ABORT_MSG_UNLESS (writer.Open (fileName, header), "Cannot create " << fileName);
+  Simulator::ScheduleDestroy (&MetricsWriter::Close, &writer);
+}
+
+/**
+ * Install the flows of the --trafficMatrix file and print how long that
+ * took and how much heap it took per flow, latency histograms included.
+ *
+ * \param start the current time, which application times are relative to
+ * \param sinks the sink applications installed are added to it
+ */
+void
+RoutingExperiment::SetupTrafficMatrix (NodeContainer nodes, Ipv4InterfaceContainer interfaces, Time start,
+                                       ApplicationContainer &sinks)
+{
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now ();
+  uint64_t heapStart = MemoryStats::GetHeapBytes ();
+
+  TrafficMatrix matrix;
+  std::string error;
+  if (!matrix.Load (m_trafficMatrix, port, error))
+    {
+      NS_FATAL_ERROR (error);
+    }
+  // a generator starts a flow that is already due at once, so with
+  // --replications every child would start it at the fork, or never run
+  // it if it has stopped by then
+  for (uint32_t i = 0; i < matrix.GetNFlows (); i++)
+    {
+      NS_ABORT_MSG_IF (Seconds (matrix.GetFlow (i).start) < start,
+                       m_trafficMatrix << ": flow " << i << " starts at " << matrix.GetFlow (i).start
+                                       << " s, before the --forkWarmup of " << start.GetSeconds () << " s");
+    }
+  if (m_tracing >= TRACING_METRICS)
+    {
+      m_latency.SetFlows (matrix.GetNFlows ());
+      m_goodput.SetFlows (matrix.GetNFlows ());
+    }
+  TrafficGenerator::Pattern pattern = m_traffic == "poisson" ? TrafficGenerator::POISSON : TrafficGenerator::CBR;
+  if (!matrix.Install (nodes, interfaces, pattern, start, Seconds (m_totalTime), error))
+    {
+      NS_FATAL_ERROR (m_trafficMatrix << ": " << error);
+    }
+  if (m_tracing >= TRACING_METRICS)
+    {
+      ApplicationContainer sources = matrix.GetSources ();
+      for (ApplicationContainer::Iterator i = sources.Begin (); i != sources.End (); ++i)
+        {
+          (*i)->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LatencyRecorder::Tx, &m_latency));
+        }
+    }
+  sinks.Add (matrix.GetSinks ());
+  m_nSinks = matrix.GetSinks ().GetN ();
+
+  double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - wallStart).count ();
+  int64_t heap = MemoryStats::GetHeapBytes () - heapStart;
+  std::cout << "Traffic matrix: " << matrix.GetNFlows () << " flows, " << matrix.GetSources ().GetN () << " sources, "
+            << matrix.GetSinks ().GetN () << " sinks set up in " << seconds * 1000 << " ms, "
+            << (matrix.GetNFlows () > 0 ? heap / int64_t (matrix.GetNFlows ()) : 0) << " bytes of heap per flow"
+            << std::endl;
+}
+
 Ptr<Socket>
 RoutingExperiment::SetupPacketReceive (Ipv4Address addr, Ptr<Node> node)
 {
@@ -193,11 +614,156 @@ RoutingExperiment::SetupPacketReceive (Ipv4Address addr, Ptr<Node> node)
 std::string
 RoutingExperiment::CommandSetup (int argc, char **argv)
 {
+  std::string rxLog ("none");
+  std::string tracing ("metrics");
+  std::string traceCompression ("none");
+  std::string metricsFormat ("csv");
+  std::string phyTrace ("ascii");
+  std::string channel ("yans");
+  std::string protocol ("AODV");
+  std::string scheduler ("map");
+
   CommandLine cmd;
   cmd.AddValue ("CSVfileName", "The name of the CSV output file name", m_CSVfileName);
   cmd.AddValue ("traceMobility", "Enable mobility tracing", m_traceMobility);
-  cmd.AddValue ("protocol", "AODV", m_protocol);
+  cmd.AddValue ("protocol", "Routing protocol, by number or name: " + RoutingRegistry::Get ().List (), protocol);
+  cmd.AddValue ("nSinks", "Number of source/sink pairs", m_nSinks);
+  cmd.AddValue ("txp", "Transmit power in dBm", m_txp);
+  cmd.AddValue ("nWifis", "Number of mobile nodes (as many static nodes are added)", m_nWifis);
+  cmd.AddValue ("nodeSpeed", "Maximum node speed in m/s", m_nodeSpeed);
+  cmd.AddValue ("nodePause", "Node pause time in s", m_nodePause);
+  cmd.AddValue ("mobilityReplay", "Replay this manet-mobility-gen schedule instead of the random waypoint models", m_mobilityReplay);
+  cmd.AddValue ("channel", "Wifi channel: yans, or grid to only deliver frames to receivers in detection range", channel);
+  cmd.AddValue ("lossCache", "Cache the propagation loss of node pairs while both are stationary", m_lossCache);
+  cmd.AddValue ("rate", "Application data rate", m_rate);
+  cmd.AddValue ("traffic", "Traffic sources: onoff, or cbr or poisson from a pooled TrafficGenerator per node", m_traffic);
+  cmd.AddValue ("trafficMatrix", "Read the flows from this file (src dst start stop rate size tcp|udp [port] per line) instead of pairing nodes; onoff means cbr", m_trafficMatrix);
+  cmd.AddValue ("totalTime", "Simulation time in s", m_totalTime);
+  cmd.AddValue ("scheduler", "Event scheduler: map, heap, list, calendar, ladder or a Scheduler TypeId", scheduler);
+  cmd.AddValue ("schedulerLog", "Record the scheduler operations to this file, for manet-scheduler-bench", m_schedulerLog);
+  cmd.AddValue ("profile", "Print the wall-clock time spent per event type and write <csv name>-profile.folded for flame graphs", m_profile);
+  cmd.AddValue ("progress", "Report the progress of the run on stderr every this many wall-clock seconds (0 to disable)", m_progress);
+  cmd.AddValue ("replications", "Run the warmup once and fork this many replications of the rest of the run (0 to disable)", m_replications);
+  cmd.AddValue ("forkWarmup", "Simulated seconds shared by the replications, at most the application start time (100 s)", m_forkWarmup);
+  cmd.AddValue ("metricsFlushBytes", "Write the CSV buffer out once it holds this many bytes", m_metricsFlushBytes);
+  cmd.AddValue ("metricsFlushInterval", "Write the CSV buffer out at least every this many simulated seconds (0 to disable)", m_metricsFlushInterval);
+  cmd.AddValue ("metricsFormat", "Format of the metrics tables: csv, or gorilla for compressed time series (.mts, see manet-trace-convert)", metricsFormat);
+  cmd.AddValue ("nodeMetrics", "Keep per-node metrics of every second in memory and write them to <csv name>-nodes.bin at the end", m_nodeMetrics);
+  cmd.AddValue ("liveMetrics", "Publish the current counters every second in this file, e.g. under /dev/shm, for manet-live-monitor", m_liveMetricsFile);
+  cmd.AddValue ("metricsPort", "Serve the current counters in the Prometheus format on this 127.0.0.1 port (0 for any free one, -1 to disable)", m_metricsPort);
+  cmd.AddValue ("memoryStats", "Write the memory use of the run every second to <csv name>-memory.csv", m_memoryStats);
+  cmd.AddValue ("tracing", "Output profile: none, metrics, flow or full", tracing);
+  cmd.AddValue ("flowInterval", "Simulated seconds between two FlowMonitor exports of the flow profile", m_flowInterval);
+  cmd.AddValue ("phyTrace", "PHY trace format of the full profile: ascii (<trace name>.tr) or binary (<trace name>.phy, see manet-trace-convert)", phyTrace);
+  cmd.AddValue ("traceCompression", "Compress the ASCII and pcap traces: none, gzip or zstd", traceCompression);
+  cmd.AddValue ("rxLog", "Per-packet receive log: none, text or binary (<trace name>.rxlog, see manet-trace-convert)", rxLog);
+  cmd.AddValue ("rxLogCapacity", "Number of records buffered by the binary receive log", m_rxLogCapacity);
   cmd.Parse (argc, argv);
+
+  if (rxLog == "none")
+    {
+      m_rxLogMode = RX_LOG_NONE;
+    }
+  else if (rxLog == "text")
+    {
+      m_rxLogMode = RX_LOG_TEXT;
+    }
+  else if (rxLog == "binary")
+    {
+      m_rxLogMode = RX_LOG_BINARY;
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown --rxLog mode " << rxLog);
+    }
+
+  if (metricsFormat == "csv")
+    {
+      m_metricsFormat = METRICS_CSV;
+    }
+  else if (metricsFormat == "gorilla")
+    {
+      m_metricsFormat = METRICS_GORILLA;
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown --metricsFormat " << metricsFormat);
+    }
+
+  if (tracing == "none")
+    {
+      m_tracing = TRACING_NONE;
+    }
+  else if (tracing == "metrics")
+    {
+      m_tracing = TRACING_METRICS;
+    }
+  else if (tracing == "flow")
+    {
+      m_tracing = TRACING_FLOW;
+    }
+  else if (tracing == "full")
+    {
+      m_tracing = TRACING_FULL;
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown --tracing profile " << tracing);
+    }
+
+  const RoutingRegistry::Protocol *routing = RoutingRegistry::Get ().Find (protocol);
+  if (routing == 0)
+    {
+      NS_FATAL_ERROR ("Unknown --protocol " << protocol << ", expected one of " << RoutingRegistry::Get ().List ());
+    }
+  m_protocol = routing->id;
+  m_protocolName = routing->name;
+
+  NS_ABORT_MSG_UNLESS (channel == "yans" || channel == "grid", "Unknown --channel " << channel);
+  m_gridChannel = channel == "grid";
+
+  NS_ABORT_MSG_UNLESS (m_traffic == "onoff" || m_traffic == "cbr" || m_traffic == "poisson",
+                       "Unknown --traffic " << m_traffic);
+
+  NS_ABORT_MSG_UNLESS (phyTrace == "ascii" || phyTrace == "binary", "Unknown --phyTrace format " << phyTrace);
+  m_binaryPhyTrace = phyTrace == "binary";
+
+  if (scheduler == "map" || scheduler == "heap" || scheduler == "list" || scheduler == "calendar"
+      || scheduler == "ladder")
+    {
+      m_scheduler = "ns3::" + std::string (1, std::toupper (scheduler[0])) + scheduler.substr (1) + "Scheduler";
+    }
+  else
+    {
+      m_scheduler = scheduler;
+    }
+  TypeId schedulerTid;
+  NS_ABORT_MSG_UNLESS (TypeId::LookupByNameFailSafe (m_scheduler, &schedulerTid)
+                       && schedulerTid.IsChildOf (Scheduler::GetTypeId ()),
+                       "Unknown --scheduler " << scheduler);
+  NS_ABORT_MSG_IF (m_replications > 0 && (!m_schedulerLog.empty () || m_profile || m_progress > 0),
+                   "--schedulerLog, --profile and --progress cannot be used with --replications");
+  NS_ABORT_MSG_IF (m_progress < 0, "--progress must not be negative");
+  NS_ABORT_MSG_IF (m_flowInterval <= 0, "--flowInterval must be positive");
+  NS_ABORT_MSG_IF (m_memoryStats && m_tracing < TRACING_METRICS, "--memoryStats needs --tracing=metrics or above");
+  NS_ABORT_MSG_IF (m_memoryStats && m_tracing >= TRACING_FULL,
+                   "--memoryStats cannot be used with --tracing=full, its samples would shift the packet uids of the traces");
+  NS_ABORT_MSG_IF (m_nodeMetrics && m_tracing < TRACING_METRICS, "--nodeMetrics needs --tracing=metrics or above");
+  NS_ABORT_MSG_IF (!m_liveMetricsFile.empty () && m_tracing < TRACING_METRICS,
+                   "--liveMetrics needs --tracing=metrics or above");
+  NS_ABORT_MSG_IF (m_metricsPort >= 0 && m_tracing < TRACING_METRICS,
+                   "--metricsPort needs --tracing=metrics or above");
+  NS_ABORT_MSG_IF (m_metricsPort > 65535, "--metricsPort must be below 65536");
+
+  NS_ABORT_MSG_IF (m_replications > 0 && m_tracing >= TRACING_FULL,
+                   "--replications cannot be used with --tracing=full, whose traces start before the fork");
+  NS_ABORT_MSG_IF (m_replications > 0 && (m_forkWarmup < 0 || m_forkWarmup > 100.0 || m_forkWarmup >= m_totalTime),
+                   "--forkWarmup must be between 0 and the application start time, 100 s");
+
+  if (!m_traceCompressor.SetCodec (traceCompression))
+    {
+      NS_FATAL_ERROR ("Unknown --traceCompression codec " << traceCompression);
+    }
   return m_CSVfileName;
 }
 
@@ -205,50 +771,79 @@ int
 main (int argc, char *argv[])
 {
   RoutingExperiment experiment;
-  std::string CSVfileName = experiment.CommandSetup (argc,argv);
-
-  //blank out the last output file and write the column headers
-  std::ofstream out (CSVfileName.c_str ());
-  out << "SimulationSecond," <<
-  "ReceiveRate," <<
-  "PacketsReceived," <<
-  "NumberOfSinks," <<
-  "RoutingProtocol," <<
-  "TransmissionPower" <<
-  std::endl;
-  out.close ();
-
-  // half of the nodes
-  int nSinks = 15;
-  //int nSinks = 10;
-  double txp = 7.5;
-  
- 
-  experiment.Run (nSinks, txp, CSVfileName);
+  experiment.CommandSetup (argc,argv);
+  experiment.Run ();
+}
+
+void
+RoutingExperiment::Run ()
+{
+  RunScenario ();
+  // the trace files are closed once the nodes are gone, with the
+  // containers of RunScenario () that hold them
+  uint32_t failed = m_traceCompressor.Wait ();
+  NS_ABORT_MSG_IF (failed > 0, failed << " trace compressor(s) failed, the compressed traces are incomplete");
 }
 
 void
-RoutingExperiment::Run (int nSinks, double txp, std::string CSVfileName)
+RoutingExperiment::RunScenario ()
 {
-  Packet::EnablePrinting ();
-  m_nSinks = nSinks;
-  m_txp = txp;
-  m_CSVfileName = CSVfileName;
-
-  // might be the nodes
-  //int nWifis = 50;
-  int nWifis = 15;
+  if (m_tracing >= TRACING_FULL && !m_binaryPhyTrace)
+    {
+      // full packet metadata is only needed for the ASCII traces
+      Packet::EnablePrinting ();
+    }
+  // the recorder goes innermost, so that it logs exactly what the bare
+  // scheduler is asked to do
+  ObjectFactory scheduler;
+  scheduler.SetTypeId (m_scheduler);
+  if (!m_schedulerLog.empty ())
+    {
+      ObjectFactory recording;
+      recording.SetTypeId ("ns3::RecordingScheduler");
+      recording.Set ("Inner", ObjectFactoryValue (scheduler));
+      recording.Set ("FileName", StringValue (m_schedulerLog));
+      scheduler = recording;
+    }
+  if (m_memoryStats)
+    {
+      ObjectFactory queueLength;
+      queueLength.SetTypeId ("ns3::QueueLengthScheduler");
+      queueLength.Set ("Inner", ObjectFactoryValue (scheduler));
+      scheduler = queueLength;
+    }
+  if (m_profile)
+    {
+      ObjectFactory profiling;
+      profiling.SetTypeId ("ns3::ProfilingScheduler");
+      profiling.Set ("Inner", ObjectFactoryValue (scheduler));
+      profiling.Set ("FoldedFileName", StringValue (CompanionFileName ("-profile.folded")));
+      scheduler = profiling;
+    }
+  if (m_progress > 0)
+    {
+      ObjectFactory progress;
+      progress.SetTypeId ("ns3::ProgressScheduler");
+      progress.Set ("Inner", ObjectFactoryValue (scheduler));
+      progress.Set ("Interval", DoubleValue (m_progress));
+      progress.Set ("StopTime", TimeValue (Seconds (m_totalTime)));
+      scheduler = progress;
+    }
+  Simulator::SetScheduler (scheduler);
+
+  int nSinks = m_nSinks;
+  double txp = m_txp;
+
+  int nWifis = m_nWifis;
   uint32_t packetSize = 512;
   std::string factory = "ns3::TcpSocketFactory";  
 
-  // simulation time: 300 dapat CHANGE LATER!
-  double TotalTime = 300.0;
-  std::string rate ("2048bps");
+  double TotalTime = m_totalTime;
+  std::string rate (m_rate);
   std::string phyMode ("DsssRate11Mbps");
-  std::string tr_name ("AODV");
-  int nodeSpeed = 20; //in m/s
-  int nodePause = 0; //in s
-  m_protocolName = "protocol";
+  std::string tr_name (m_protocolName);
+  int nodeSpeed = m_nodeSpeed;
+  int nodePause = m_nodePause;
 
   // packet size (reference: examples/wireless/wifi-tcp.cc)
   //Config::SetDefault  ("ns3::OnOffApplication::PacketSize",StringValue ("64"));
@@ -274,11 +869,34 @@ RoutingExperiment::Run (int nSinks, double txp, std::string CSVfileName)
   WifiHelper wifi;
   wifi.SetStandard (WIFI_PHY_STANDARD_80211b);
 
-  YansWifiPhyHelper wifiPhy =  YansWifiPhyHelper::Default ();
-  YansWifiChannelHelper wifiChannel;
-  wifiChannel.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
-  wifiChannel.AddPropagationLoss ("ns3::FriisPropagationLossModel");
-  wifiPhy.SetChannel (wifiChannel.Create ());
+  GridYansWifiPhyHelper wifiPhy (m_gridChannel);
+  // what YansWifiChannelHelper would build, with the loss cache and the
+  // spatially indexed channel as options
+  Ptr<FriisPropagationLossModel> friis = CreateObject<FriisPropagationLossModel> ();
+  Ptr<PropagationLossModel> loss = friis;
+  Ptr<CachedPropagationLossModel> lossCache;
+  if (m_lossCache)
+    {
+      lossCache = CreateObject<CachedPropagationLossModel> ();
+      lossCache->SetInner (friis);
+      loss = lossCache;
+    }
+  Ptr<PropagationDelayModel> delay = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  if (m_gridChannel)
+    {
+      Ptr<GridYansWifiChannel> channel = CreateObject<GridYansWifiChannel> ();
+      channel->SetPropagationDelayModel (delay);
+      channel->SetPropagationLossModel (loss);
+      channel->SetFriisModel (friis);
+      wifiPhy.SetChannel (channel);
+    }
+  else
+    {
+      Ptr<YansWifiChannel> channel = CreateObject<YansWifiChannel> ();
+      channel->SetPropagationDelayModel (delay);
+      channel->SetPropagationLossModel (loss);
+      wifiPhy.SetChannel (channel);
+    }
 
   // Add a mac and disable rate control
   WifiMacHelper wifiMac;
@@ -292,56 +910,66 @@ RoutingExperiment::Run (int nSinks, double txp, std::string CSVfileName)
   wifiMac.SetType ("ns3::AdhocWifiMac");
   NetDeviceContainer adhocDevices = wifi.Install (wifiPhy, wifiMac, all_Nodes);
 
-  MobilityHelper mobilityAdhoc;
-  MobilityHelper mobilityStatic;
-  
-  int64_t streamIndex = 0; // used to get consistent mobility across scenarios
+  if (!m_mobilityReplay.empty ())
+    {
+      // precomputed schedule from manet-mobility-gen, mobile nodes first
+      Ptr<MobilityReplayFile> schedule = Create<MobilityReplayFile> ();
+      NS_ABORT_MSG_UNLESS (schedule->Open (m_mobilityReplay), "Cannot map mobility schedule " << m_mobilityReplay);
+      NS_ABORT_MSG_UNLESS (schedule->GetNNodes () == all_Nodes.GetN (),
+                           m_mobilityReplay << " has " << schedule->GetNNodes () << " nodes, the scenario "
+                                            << all_Nodes.GetN ());
+      // past its end, a node would keep the velocity of its last segment
+      // and drift out of the area
+      NS_ABORT_MSG_IF (schedule->GetTotalTime () < m_totalTime,
+                       m_mobilityReplay << " covers " << schedule->GetTotalTime () << " s, the scenario "
+                                        << m_totalTime << " s");
+      schedule->Install (all_Nodes);
+    }
+  else
+    {
+      MobilityHelper mobilityAdhoc;
+      MobilityHelper mobilityStatic;
 
-  ObjectFactory pos;
-  pos.SetTypeId ("ns3::RandomRectanglePositionAllocator");
+      int64_t streamIndex = 0; // used to get consistent mobility across scenarios
+
+      ObjectFactory pos;
+      pos.SetTypeId ("ns3::RandomRectanglePositionAllocator");
 //  pos.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
 //  pos.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=1500.0]"));
-  pos.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
-  pos.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
+      pos.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
+      pos.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=25.0]"));
 
-  Ptr<PositionAllocator> taPositionAlloc = pos.Create ()->GetObject<PositionAllocator> ();
-  streamIndex += taPositionAlloc->AssignStreams (streamIndex);
+      Ptr<PositionAllocator> taPositionAlloc = pos.Create ()->GetObject<PositionAllocator> ();
+      streamIndex += taPositionAlloc->AssignStreams (streamIndex);
 
-  std::stringstream ssSpeed;
-  ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << nodeSpeed << "]";
-  std::stringstream ssPause;
-  ssPause << "ns3::ConstantRandomVariable[Constant=" << nodePause << "]";
-  
-  // mobile nodes
-  mobilityAdhoc.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
-                                  "Speed", StringValue (ssSpeed.str ()),
-                                  "Pause", StringValue (ssPause.str ()),
-                                  "PositionAllocator", PointerValue (taPositionAlloc));
-  mobilityAdhoc.SetPositionAllocator (taPositionAlloc);
-  mobilityAdhoc.Install (adhocNodes);
-  
-  streamIndex += mobilityAdhoc.AssignStreams (adhocNodes, streamIndex);
-  NS_UNUSED (streamIndex); // From this point, streamIndex is unused
+      std::stringstream ssSpeed;
+      ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << nodeSpeed << "]";
+      std::stringstream ssPause;
+      ssPause << "ns3::ConstantRandomVariable[Constant=" << nodePause << "]";
 
-  // static nodes
-  mobilityStatic.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
-  mobilityStatic.SetPositionAllocator (taPositionAlloc);
-  mobilityStatic.Install (staticNodes);
+      // mobile nodes
+      mobilityAdhoc.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
+                                      "Speed", StringValue (ssSpeed.str ()),
+                                      "Pause", StringValue (ssPause.str ()),
+                                      "PositionAllocator", PointerValue (taPositionAlloc));
+      mobilityAdhoc.SetPositionAllocator (taPositionAlloc);
+      mobilityAdhoc.Install (adhocNodes);
+
+      streamIndex += mobilityAdhoc.AssignStreams (adhocNodes, streamIndex);
+      NS_UNUSED (streamIndex); // From this point, streamIndex is unused
+
+      // static nodes
+      mobilityStatic.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+      mobilityStatic.SetPositionAllocator (taPositionAlloc);
+      mobilityStatic.Install (staticNodes);
+    }
   
   
-  AodvHelper aodv;
-  DsrMainHelper dsrMain;
-  Ipv4ListRoutingHelper list;
   InternetStackHelper internet;
-  Ipv4StaticRoutingHelper staticRouting;
 
   // tcp/ip
-  list.Add (staticRouting, 0);
-  list.Add (aodv, 100);
-  m_protocolName = "AODV";
   internet.SetTcp("ns3::TcpL4Protocol");
-  internet.SetRoutingHelper (list);
-  internet.Install (all_Nodes);
+  RoutingRegistry::Get ().Find (m_protocolName)->install (internet, all_Nodes);
 
   NS_LOG_INFO ("assigning ip address");
 
@@ -350,29 +978,115 @@ RoutingExperiment::Run (int nSinks, double txp, std::string CSVfileName)
   Ipv4InterfaceContainer adhocInterfaces;
   adhocInterfaces = addressAdhoc.Assign (adhocDevices);
 
-  OnOffHelper onoff1 (factory , Address ());
-  onoff1.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1.0]"));
-  onoff1.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.0]"));
-  // packet size (reference: examples/wireless/wifi-tcp.cc)
-  onoff1.SetAttribute ("PacketSize", UintegerValue (packetSize)); 
+  // with --replications, everything from here on happens in each child,
+  // whose clock starts at the end of the warmup
+  Time start = Seconds (0);
+  if (m_replications > 0)
+    {
+      if (!ForkReplications ())
+        {
+          Simulator::Destroy ();
+          return;
+        }
+      start = Simulator::Now ();
+      std::ostringstream suffix;
+      suffix << "-rep" << m_replication << ".csv";
+      m_CSVfileName = CompanionFileName (suffix.str ());
+      if (!m_liveMetricsFile.empty ())
+        {
+          std::ostringstream live;
+          live << m_liveMetricsFile << "-rep" << m_replication;
+          m_liveMetricsFile = live.str ();
+        }
+      if (m_metricsPort > 0)
+        {
+          m_metricsPort += m_replication;
+        }
+    }
 
-  for (int i = 0; i < nSinks; i++)
+  // every sink feeds the per-flow accounting, whichever way flows are set up
+  ApplicationContainer sinks;
+  if (!m_trafficMatrix.empty ())
     {
-      Ptr<UniformRandomVariable> var = CreateObject<UniformRandomVariable> ();
+      SetupTrafficMatrix (all_Nodes, adhocInterfaces, start, sinks);
+    }
+  else
+    {
+      OnOffHelper onoff1 (factory , Address ());
+      onoff1.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1.0]"));
+      onoff1.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0.0]"));
+      // packet size (reference: examples/wireless/wifi-tcp.cc)
+      onoff1.SetAttribute ("PacketSize", UintegerValue (packetSize)); 
+
+      // the flows of a source node share one generator
+      std::map<uint32_t, Ptr<TrafficGenerator> > generators;
+
+      m_latency.SetFlows (nSinks);
+      m_goodput.SetFlows (nSinks);
+      for (int i = 0; i < nSinks; i++)
+        {
+          Ptr<UniformRandomVariable> var = CreateObject<UniformRandomVariable> ();
      
-      //create packet sink to receive tcp packets. reference: examples/wireless/wifi-tcp.cc
-      Address sinkAddress (InetSocketAddress (adhocInterfaces.GetAddress (i), port));
-      PacketSinkHelper sinkHelper (factory, sinkAddress);
-      ApplicationContainer sinkApp = sinkHelper.Install (all_Nodes.Get(i));
-      sinkApp.Start (Seconds (var->GetValue (100.0,101.0)));
-      sinkApp.Stop (Seconds (TotalTime));
-      
-      AddressValue remoteAddress (InetSocketAddress (adhocInterfaces.GetAddress (i), port));
-      onoff1.SetAttribute ("Remote", remoteAddress);
+          //create packet sink to receive tcp packets. reference: examples/wireless/wifi-tcp.cc
+          Address sinkAddress (InetSocketAddress (adhocInterfaces.GetAddress (i), port));
+          PacketSinkHelper sinkHelper (factory, sinkAddress);
+          ApplicationContainer sinkApp = sinkHelper.Install (all_Nodes.Get(i));
+          sinkApp.Start (Seconds (var->GetValue (100.0,101.0)) - start);
+          sinkApp.Stop (Seconds (TotalTime) - start);
+          sinks.Add (sinkApp);
+
+          // flow i is the pair of source i + nSinks and sink i
+          if (m_traffic != "onoff")
+            {
+              Ptr<TrafficGenerator> &generator = generators[i + nSinks];
+              if (generator == 0)
+                {
+                  generator = CreateObject<TrafficGenerator> ();
+                  generator->SetAttribute ("Protocol", TypeIdValue (TypeId::LookupByName (factory)));
+                  generator->SetAttribute ("Pattern", EnumValue (m_traffic == "cbr" ? TrafficGenerator::CBR
+                                                                 : TrafficGenerator::POISSON));
+                  all_Nodes.Get (i + nSinks)->AddApplication (generator);
+                  // flows start at their own time, all of them after 100 s
+                  generator->SetStartTime (Seconds (100.0) - start);
+                  generator->SetStopTime (Seconds (TotalTime) - start);
+                  if (m_tracing >= TRACING_METRICS)
+                    {
+                      generator->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LatencyRecorder::Tx, &m_latency));
+                    }
+                }
+              generator->AddFlow (InetSocketAddress (adhocInterfaces.GetAddress (i), port), DataRate (rate),
+                                  packetSize, Seconds (var->GetValue (100.0,101.0)), Seconds (TotalTime), i);
+              continue;
+            }
+
+          AddressValue remoteAddress (InetSocketAddress (adhocInterfaces.GetAddress (i), port));
+          onoff1.SetAttribute ("Remote", remoteAddress);
 
-      ApplicationContainer temp = onoff1.Install (all_Nodes.Get (i + nSinks));
-      temp.Start (Seconds (var->GetValue (100.0,101.0)));
-      temp.Stop (Seconds (TotalTime));
+          ApplicationContainer temp = onoff1.Install (all_Nodes.Get (i + nSinks));
+          temp.Start (Seconds (var->GetValue (100.0,101.0)) - start);
+          temp.Stop (Seconds (TotalTime) - start);
+
+          if (m_tracing >= TRACING_METRICS)
+            {
+              temp.Get (0)->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LatencyRecorder::Tx, &m_latency, i));
+            }
+        }
+    }
+  if (m_tracing >= TRACING_METRICS)
+    {
+      for (ApplicationContainer::Iterator i = sinks.Begin (); i != sinks.End (); ++i)
+        {
+          (*i)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&LatencyRecorder::Rx, &m_latency));
+          (*i)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&GoodputRecorder::Rx, &m_goodput));
+        }
+    }
+  if (m_rxLogMode != RX_LOG_NONE)
+    {
+      for (ApplicationContainer::Iterator i = sinks.Begin (); i != sinks.End (); ++i)
+        {
+          (*i)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&RoutingExperiment::SinkRx, this,
+                                                                     (*i)->GetNode ()->GetId ()));
+        }
     }
 
   std::stringstream ss;
@@ -392,31 +1106,225 @@ RoutingExperiment::Run (int nSinks, double txp, std::string CSVfileName)
   std::string sRate = ss4.str ();
 
   NS_LOG_INFO ("Configure Tracing.");
-  tr_name = tr_name + "_" + m_protocolName +"_" + nodes + "nodes_" + sNodeSpeed + "speed_" + sNodePause + "pause_" + sRate + "rate";
-  
-  AsciiTraceHelper ascii;
-  Ptr<OutputStreamWrapper> osw = ascii.CreateFileStream ((tr_name + ".tr").c_str());
-  MobilityHelper::EnableAsciiAll (ascii.CreateFileStream (tr_name + ".mob"));
-  // enable tr file
-  wifiPhy.EnableAsciiAll (osw); 
-  // enable pcap file
-  wifiPhy.EnablePcap (tr_name, adhocDevices);
-  
+  tr_name = tr_name + "_" + nodes + "nodes_" + sNodeSpeed + "speed_" + sNodePause + "pause_" + sRate + "rate";
+  if (m_replication >= 0)
+    {
+      std::ostringstream suffix;
+      suffix << "_rep" << m_replication;
+      tr_name += suffix.str ();
+    }
   
-  //Ptr<FlowMonitor> flowmon;
-  //FlowMonitorHelper flowmonHelper;
-  //flowmon = flowmonHelper.InstallAll ();
+  // trace sources of a profile that is not selected are never connected
+  AnimationInterface *anim = 0;
+  if (m_tracing >= TRACING_FULL)
+    {
+      // route every trace file through the compressor before any of them
+      // is opened, so that no compressor inherits another one's FIFO
+      std::vector<std::string> traceFiles;
+      traceFiles.push_back (tr_name + (m_binaryPhyTrace ? ".phy" : ".tr"));
+      if (m_traceMobility)
+        {
+          traceFiles.push_back (tr_name + ".mob");
+        }
+      PcapHelper pcapHelper;
+      for (uint32_t i = 0; i < adhocDevices.GetN (); i++)
+        {
+          traceFiles.push_back (pcapHelper.GetFilenameFromDevice (tr_name, adhocDevices.Get (i)));
+        }
+      for (uint32_t i = 0; i < traceFiles.size (); i++)
+        {
+          NS_ABORT_MSG_UNLESS (m_traceCompressor.Prepare (traceFiles[i]),
+                               "Cannot set up compression for " << traceFiles[i]);
+        }
+
+      AsciiTraceHelper ascii;
+      if (m_traceMobility)
+        {
+          MobilityHelper::EnableAsciiAll (ascii.CreateFileStream (tr_name + ".mob"));
+        }
+      if (m_binaryPhyTrace)
+        {
+          NS_ABORT_MSG_UNLESS (m_phyTrace.Open (tr_name + ".phy"), "Cannot create " << tr_name << ".phy");
+          m_phyTrace.Install (adhocDevices);
+          Simulator::ScheduleDestroy (&PhyBinaryTrace::Close, &m_phyTrace);
+        }
+      else
+        {
+          // enable tr file
+          Ptr<OutputStreamWrapper> osw = ascii.CreateFileStream ((tr_name + ".tr").c_str());
+          wifiPhy.EnableAsciiAll (osw);
+        }
+      // enable pcap file
+      wifiPhy.EnablePcap (tr_name, adhocDevices);
+      anim = new AnimationInterface (m_protocolName + ".xml");
+    }
+
+  Ptr<FlowMonitor> flowmon;
+  FlowMonitorHelper flowmonHelper;
+  if (m_tracing >= TRACING_FLOW)
+    {
+      if (m_tracing < TRACING_FULL)
+        {
+          // only the XML file of the full profile needs fine histograms
+          FlowExporter::SetCoarseHistograms (flowmonHelper);
+        }
+      flowmon = flowmonHelper.InstallAll ();
+
+      OpenMetrics (m_flowMetrics, CompanionFileName ("-flowmon.csv"),
+                   "SimulationSecond,"
+                   "FlowId,"
+                   "Source,"
+                   "Destination,"
+                   "SourcePort,"
+                   "DestinationPort,"
+                   "Protocol,"
+                   "TxPackets,"
+                   "TxBytes,"
+                   "RxPackets,"
+                   "RxBytes,"
+                   "DelaySum,"
+                   "JitterSum,"
+                   "LostPackets");
+      m_flowExporter.Start (flowmon, DynamicCast<Ipv4FlowClassifier> (flowmonHelper.GetClassifier ()),
+                            &m_flowMetrics, Seconds (m_flowInterval));
+    }
+
+  if (m_tracing >= TRACING_METRICS)
+    {
+      //blank out the last output file and write the column headers
+      OpenMetrics (m_metrics, m_CSVfileName,
+                   "SimulationSecond,"
+                   "ReceiveRate,"
+                   "PacketsReceived,"
+                   "NumberOfSinks,"
+                   "RoutingProtocol,"
+                   "TransmissionPower,"
+                   "ControlPackets,"
+                   "ControlBytes,"
+                   "DelayP50,"
+                   "DelayP95,"
+                   "DelayP99,"
+                   "DelayMax");
+
+      // per node breakdown of the routing control traffic
+      OpenMetrics (m_overheadMetrics, CompanionFileName ("-overhead.csv"),
+                   "SimulationSecond,"
+                   "Node,"
+                   "MessageType,"
+                   "Packets,"
+                   "Bytes");
+      m_overhead.Install (all_Nodes);
+      if (m_nodeMetrics)
+        {
+          m_nodeTracer.Install (all_Nodes, TotalTime, 1.0);
+        }
+
+      // per flow end-to-end delay
+      OpenMetrics (m_latencyMetrics, CompanionFileName ("-latency.csv"),
+                   "SimulationSecond,"
+                   "FlowId,"
+                   "Packets,"
+                   "DelayP50,"
+                   "DelayP95,"
+                   "DelayP99,"
+                   "DelayMax");
+
+      // per flow goodput
+      OpenMetrics (m_goodputMetrics, CompanionFileName ("-goodput.csv"),
+                   "SimulationSecond,"
+                   "FlowId,"
+                   "RxBytes,"
+                   "Goodput");
+
+      if (m_memoryStats)
+        {
+          OpenMetrics (m_memoryMetrics, CompanionFileName ("-memory.csv"),
+                       "SimulationSecond,"
+                       "RssKiB,"
+                       "HeapBytes,"
+                       "PacketsCreated,"
+                       "QueuedPackets,"
+                       "QueuedBytes,"
+                       "PendingEvents");
+          m_memory.Install (all_Nodes);
+        }
+
+      if (!m_liveMetricsFile.empty () || m_metricsPort >= 0)
+        {
+          m_liveMetrics.SetFlows (m_goodput.GetNFlows ());
+          m_liveMetrics.Install (all_Nodes);
+        }
+      if (!m_liveMetricsFile.empty ())
+        {
+          NS_ABORT_MSG_UNLESS (m_liveMetrics.Open (m_liveMetricsFile), "Cannot create " << m_liveMetricsFile);
+          Simulator::ScheduleDestroy (&LiveMetrics::Close, &m_liveMetrics);
+        }
+      if (m_metricsPort >= 0)
+        {
+          std::ostringstream labels;
+          labels << "protocol=\"" << m_protocolName << "\",nodes=\"" << m_nWifis
+                 << "\",speed=\"" << m_nodeSpeed << "\",txp=\"" << m_txp
+                 << "\",run=\"" << RngSeedManager::GetRun () << "\"";
+          if (m_replications > 0)
+            {
+              labels << ",replication=\"" << m_replication << "\"";
+            }
+          std::string error;
+          NS_ABORT_MSG_UNLESS (m_exporter.Start (m_metricsPort, labels.str (), error), error);
+          Simulator::ScheduleDestroy (&MetricsExporter::Stop, &m_exporter);
+          std::cerr << "metrics: http://127.0.0.1:" << m_exporter.GetPort () << "/metrics" << std::endl;
+        }
+    }
+
+  if (m_rxLogMode == RX_LOG_BINARY)
+    {
+      NS_ABORT_MSG_UNLESS (m_rxLog.Open (tr_name + ".rxlog", m_rxLogCapacity),
+                           "Cannot create " << tr_name << ".rxlog");
+      Simulator::ScheduleDestroy (&RxLogWriter::Close, &m_rxLog);
+    }
 
   NS_LOG_INFO ("Run Simulation.");
 
-  CheckThroughput ();
+  if (m_tracing >= TRACING_METRICS)
+    {
+      CheckThroughput ();
+    }
 
-  Simulator::Stop (Seconds (TotalTime));
-  AnimationInterface anim("AODV.xml");
+  Simulator::Stop (Seconds (TotalTime) - start);
   Simulator::Run ();
 
-  //flowmon->SerializeToXmlFile ((tr_name + ".flowmon").c_str(), false, false);
+  if (!m_liveMetricsFile.empty () || m_exporter.IsStarted ())
+    {
+      m_liveMetrics.Finish ();
+      // the exporter stops at Simulator::Destroy (), make sure it
+      // serves the final state until then
+      while (m_exporter.IsStarted () && !m_exporter.Publish (m_liveMetrics.GetValues ()))
+        {
+          std::this_thread::yield ();
+        }
+    }
+
+  if (flowmon)
+    {
+      // the last, possibly partial, interval
+      m_flowExporter.Export ();
+      m_flowExporter.Stop ();
+    }
+  if (flowmon && m_tracing >= TRACING_FULL)
+    {
+      flowmon->SerializeToXmlFile ((tr_name + ".flowmon").c_str(), false, false);
+    }
+  if (m_nodeMetrics)
+    {
+      std::string nodeFileName = CompanionFileName ("-nodes.bin");
+      NS_ABORT_MSG_UNLESS (m_nodeTracer.GetMetrics ().Write (nodeFileName), "Cannot write " << nodeFileName);
+    }
+  if (lossCache)
+    {
+      NS_LOG_INFO ("Loss cache: " << lossCache->GetHits () << " hits, " << lossCache->GetMisses () << " misses");
+    }
 
   Simulator::Destroy ();
+  delete anim;
 }
 